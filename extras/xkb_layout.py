@@ -0,0 +1,369 @@
+#!/usr/bin/env python3
+"""
+Generate an unoHID keyboard layout from an XKB symbols file (Linux).
+
+    python3 extras/xkb_layout.py de_DE /usr/share/X11/xkb/symbols/de \\
+        --description "German keyboard layout." --output src/keyboard
+
+Like the XKB rules, it loads the "pc" symbols first (--include), for the keys most layouts leave
+to them: the space bar, and <LSGT>, the extra ISO key with < and >.
+
+Writes, into the output directory:
+
+    layouts/xx_YY.h             The 128 ASCII entries (see KeyboardLayout.h)
+    KeyboardLayout_xx_YY.cpp    KeyboardLayout_xx_YY, and KeyboardUnicode_xx_YY: the characters
+                                beyond ASCII, and those which need a dead key
+
+Then reports the characters the layout can't produce: printable ASCII, symbols on the keyboard
+which can't be encoded (e.g. Shift + AltGr), and, with --check, any character of a text file.
+Without --output, only the report is printed.
+
+The tables describe the layout as XKB defines it. Windows layouts of the same name mostly agree,
+but check the report, and test on the host you deploy to.
+
+Once generated, declare the layout in keyboard.h (and add it to hid_str.h, for HID_STR):
+
+    extern const uint8_t KeyboardLayout_xx_YY[];
+    extern const UnicodeKey KeyboardUnicode_xx_YY[];
+"""
+
+import argparse
+import os
+import re
+import sys
+import unicodedata
+
+# XKB key names, as HID usages (the key positions drawn in KeyboardLayout.h)
+KEYS = {
+    'TLDE': 0x35,
+    'AE01': 0x1e, 'AE02': 0x1f, 'AE03': 0x20, 'AE04': 0x21, 'AE05': 0x22, 'AE06': 0x23,
+    'AE07': 0x24, 'AE08': 0x25, 'AE09': 0x26, 'AE10': 0x27, 'AE11': 0x2d, 'AE12': 0x2e,
+    'AD01': 0x14, 'AD02': 0x1a, 'AD03': 0x08, 'AD04': 0x15, 'AD05': 0x17, 'AD06': 0x1c,
+    'AD07': 0x18, 'AD08': 0x0c, 'AD09': 0x12, 'AD10': 0x13, 'AD11': 0x2f, 'AD12': 0x30,
+    'AC01': 0x04, 'AC02': 0x16, 'AC03': 0x07, 'AC04': 0x09, 'AC05': 0x0a, 'AC06': 0x0b,
+    'AC07': 0x0d, 'AC08': 0x0e, 'AC09': 0x0f, 'AC10': 0x33, 'AC11': 0x34, 'BKSL': 0x31,
+    'LSGT': 0x32,   # ISO_KEY (0x64), stored as ISO_REPLACEMENT
+    'AB01': 0x1d, 'AB02': 0x1b, 'AB03': 0x06, 'AB04': 0x19, 'AB05': 0x05, 'AB06': 0x11,
+    'AB07': 0x10, 'AB08': 0x36, 'AB09': 0x37, 'AB10': 0x38,
+    'SPCE': 0x2c,
+}
+
+# Control characters: the same on every layout
+CONTROL = {0x08: '0x2a', 0x09: '0x2b', 0x0a: '0x28'}
+CONTROL_NAMES = ['NUL', 'SOH', 'STX', 'ETX', 'EOT', 'ENQ', 'ACK', 'BEL', 'BS  Backspace', 'TAB Tab',
+                 'LF  Enter', 'VT', 'FF', 'CR', 'SO', 'SI', 'DEL', 'DC1', 'DC2', 'DC3', 'DC4', 'NAK',
+                 'SYN', 'ETB', 'CAN', 'EM', 'SUB', 'ESC', 'FS', 'GS', 'RS', 'US']
+
+# Keysyms whose code is the character itself (Latin-1), in case keysymdef.h isn't installed
+LATIN1 = (
+    'space exclam quotedbl numbersign dollar percent ampersand apostrophe parenleft parenright '
+    'asterisk plus comma minus period slash 0 1 2 3 4 5 6 7 8 9 colon semicolon less equal greater '
+    'question at A B C D E F G H I J K L M N O P Q R S T U V W X Y Z bracketleft backslash '
+    'bracketright asciicircum underscore grave a b c d e f g h i j k l m n o p q r s t u v w x y z '
+    'braceleft bar braceright asciitilde'.split(),
+    'nobreakspace exclamdown cent sterling currency yen brokenbar section diaeresis copyright '
+    'ordfeminine guillemotleft notsign hyphen registered macron degree plusminus twosuperior '
+    'threesuperior acute mu paragraph periodcentered cedilla onesuperior masculine guillemotright '
+    'onequarter onehalf threequarters questiondown Agrave Aacute Acircumflex Atilde Adiaeresis '
+    'Aring AE Ccedilla Egrave Eacute Ecircumflex Ediaeresis Igrave Iacute Icircumflex Idiaeresis '
+    'ETH Ntilde Ograve Oacute Ocircumflex Otilde Odiaeresis multiply Oslash Ugrave Uacute '
+    'Ucircumflex Udiaeresis Yacute THORN ssharp agrave aacute acircumflex atilde adiaeresis aring '
+    'ae ccedilla egrave eacute ecircumflex ediaeresis igrave iacute icircumflex idiaeresis eth '
+    'ntilde ograve oacute ocircumflex otilde odiaeresis division oslash ugrave uacute ucircumflex '
+    'udiaeresis yacute thorn ydiaeresis'.split(),
+)
+
+# Dead keys: the combining mark they add, and whether dead key + space types the accent itself
+# (only where Windows and Linux agree, or where the hand-written tables rely on it)
+DEAD = {
+    'dead_grave': ('\u0300', '`'),
+    'dead_acute': ('\u0301', '´'),
+    'dead_circumflex': ('\u0302', '^'),
+    'dead_tilde': ('\u0303', '~'),
+    'dead_macron': ('\u0304', None),
+    'dead_breve': ('\u0306', None),
+    'dead_abovedot': ('\u0307', None),
+    'dead_diaeresis': ('\u0308', '¨'),
+    'dead_abovering': ('\u030a', None),
+    'dead_doubleacute': ('\u030b', None),
+    'dead_caron': ('\u030c', None),
+    'dead_cedilla': ('\u0327', None),
+    'dead_ogonek': ('\u0328', None),
+}
+
+LEVEL_NAMES = ['', '+ Shift', '+ AltGr', '+ Shift + AltGr']
+
+
+def load_keysyms(path):
+    keysyms = {}
+    for code, names in ((0x20, LATIN1[0]), (0xa0, LATIN1[1])):
+        for i, name in enumerate(names):
+            keysyms[name] = chr(code + i)
+    keysyms.update({'EuroSign': '€', 'guillemetleft': '«', 'guillemetright': '»',
+                    'ordmasculine': 'º', 'Ooblique': 'Ø', 'oslash': 'ø'})
+
+    if path and os.path.exists(path):
+        define = re.compile(r'#define XK_(\w+)\s+0x([0-9a-fA-F]+)\s*/\*\s*U\+([0-9A-Fa-f]+)')
+        with open(path, encoding='latin-1') as f:
+            for line in f:
+                m = define.match(line)
+                if m and m.group(1) not in keysyms:
+                    keysyms[m.group(1)] = chr(int(m.group(3), 16))
+    return keysyms
+
+
+def keysym_char(name, keysyms):
+    """The character a keysym types, or None"""
+    if name in keysyms:
+        return keysyms[name]
+    m = re.fullmatch(r'U([0-9A-Fa-f]{4,6})', name)
+    if m:
+        return chr(int(m.group(1), 16))
+    m = re.fullmatch(r'0x0*1([0-9A-Fa-f]{6})', name)     # 0x1000000 + code point
+    if m:
+        return chr(int(m.group(1), 16))
+    return None
+
+
+class Symbols:
+    """The keys of one xkb_symbols section, includes and all: {key name: [level 1, 2, 3, 4]}"""
+
+    def __init__(self, directory):
+        self.directory = directory
+        self.keys = {'SPCE': ['space']}     # Left to the "pc" symbols, which --include "" leaves out
+
+    def load(self, path, variant=None, merge='override'):
+        with open(path, encoding='utf-8') as f:
+            text = re.sub(r'//.*', '', f.read())
+
+        sections = list(re.finditer(r'((?:\w+\s+)*)xkb_symbols\s+"([^"]+)"\s*\{', text))
+        if not sections:
+            raise SystemExit('%s: no xkb_symbols section' % path)
+        chosen = None
+        for s in sections:
+            if variant == s.group(2) or (variant is None and 'default' in s.group(1).split()):
+                chosen = s
+        if chosen is None:
+            if variant is not None:
+                raise SystemExit('%s: no variant "%s"' % (path, variant))
+            chosen = sections[0]
+
+        depth, end = 1, chosen.end()
+        while depth:
+            depth += {'{': 1, '}': -1}.get(text[end], 0)
+            end += 1
+        self.parse(text[chosen.end():end - 1], merge)
+
+    def parse(self, body, merge):
+        statement = re.compile(r'(include|augment|override|replace)\s+"([^"]+)"|key\s*<(\w+)>\s*\{(.*?)\}\s*;', re.S)
+        for m in statement.finditer(body):
+            if m.group(1):
+                how = 'augment' if m.group(1) == 'augment' else 'override'
+                for part in re.split(r'[+|]', m.group(2)):
+                    name = re.fullmatch(r'(\w+)(?:\(([\w-]+)\))?', part.strip())
+                    if name:
+                        self.load(os.path.join(self.directory, name.group(1)), name.group(2), how)
+            else:
+                self.add(m.group(3), m.group(4), merge)
+
+    def add(self, key, definition, merge):
+        # symbols[Group1]= [ ... ], or the first bare [ ... ] (not type[...], actions[...]= [...])
+        m = re.search(r'symbols\[Group1\]\s*=\s*\[([^\]]*)\]', definition)
+        if not m:
+            m = re.search(r'(?:^|[{,])\s*\[([^\]]*)\]', definition)
+        if not m:
+            return
+        levels = [s.strip() for s in m.group(1).split(',')]
+        old = self.keys.get(key, [])
+        new = []
+        for i in range(max(len(old), len(levels))):
+            a = old[i] if i < len(old) else None
+            b = levels[i] if i < len(levels) else None
+            if b in (None, 'NoSymbol') or (merge == 'augment' and a not in (None, 'NoSymbol', 'VoidSymbol')):
+                new.append(a)
+            else:
+                new.append(b)
+        self.keys[key] = new
+
+
+def encode(usage, level):
+    """A key and level, in the layout encoding. None: can't be encoded"""
+    if level == 0:
+        return '0x%02x' % usage
+    if level == 1:
+        return '0x%02x|SHIFT' % usage
+    if level == 2 and usage < 0x40:
+        return '0x%02x|ALT_GR' % usage
+    return None
+
+
+def build(symbols, keysyms):
+    """Every character the keyboard can type: {char: (key, dead key or None)}. Plus what can't be encoded"""
+    direct = {}         # char: (cost, key)
+    dead_keys = {}      # dead keysym: key
+    unencodable = []
+
+    # The ISO key last: ANSI keyboards (e.g. US) don't have it, though the "pc" symbols give it < and >
+    order = [(level, name) for level in range(4) for name in KEYS if name != 'LSGT']
+    order += [(level, 'LSGT') for level in range(4)]
+    for level, name in order:
+        levels = symbols.keys.get(name, [])
+        if level >= len(levels) or levels[level] in (None, 'NoSymbol', 'VoidSymbol'):
+            continue
+        sym = levels[level]
+        key = encode(KEYS[name], level)
+        if sym in DEAD:
+            if key and sym not in dead_keys:
+                dead_keys[sym] = key
+            continue
+        c = keysym_char(sym, keysyms)
+        if c is None:
+            continue
+        if key is None:
+            if c not in direct:
+                unencodable.append((c, '<%s> %s' % (name, LEVEL_NAMES[level])))
+            continue
+        direct.setdefault(c, (key, None))
+
+    typed = dict(direct)
+    bases = [(c, key) for c, (key, _) in direct.items() if c.isalpha() or c == ' ']
+    for sym, dead in dead_keys.items():
+        mark, spacing = DEAD[sym]
+        for base, key in bases:
+            if base == ' ':
+                c = spacing
+            else:
+                c = unicodedata.normalize('NFC', base + mark)
+            if c and len(c) == 1 and c not in typed:
+                typed[c] = (key, dead)
+    return typed, unencodable
+
+
+def describe(c):
+    if c == ' ':
+        return "' '"
+    if not c.isprintable():
+        return 'U+%04X' % ord(c)
+    if c == '\\':
+        return 'bslash'
+    return c
+
+
+def ascii_fragment(typed, name, description):
+    lines = ['// ' + description,
+             '// Entries of KeyboardLayout_%s (KeyboardLayout_%s.cpp), also read by the compiler for HID_STR (hid_str.h)' % (name, name),
+             '']
+    for i in range(128):
+        if i < 0x20:
+            value, comment = CONTROL.get(i, '0x00'), CONTROL_NAMES[i]
+        elif i == 0x7f:
+            value, comment = '0x00', 'DEL'
+        else:
+            c = chr(i)
+            key, dead = typed.get(c, (None, None))
+            if key and not dead:
+                value, comment = key, describe(c)
+            elif key:
+                value, comment = '0x00', '%s  dead key + space: in KeyboardUnicode_%s' % (describe(c), name)
+            else:
+                value, comment = '0x00', '%s  not in this layout' % describe(c)
+        separator = ',' if i < 127 else ' '
+        lines.append('\t%-15s// %s' % (value + separator, comment))
+        if i == 0x1f:
+            lines.append('')
+    return '\n'.join(lines) + '\n'
+
+
+def unicode_rows(typed):
+    rows = []
+    for c in sorted(typed, key=ord):
+        key, dead = typed[c]
+        if 0x20 <= ord(c) < 0x7f and not dead:
+            continue            # In the ASCII table
+        if ord(c) < 0x20 or ord(c) > 0xffff or ord(c) == 0x7f:
+            continue
+        comment = c + ('  dead key + space' if dead and key == '0x2c' else '')
+        rows.append('\t{0x%04x, %-13s %-11s},  // %s' % (ord(c), key + ',', dead or '0', comment))
+    return rows
+
+
+def layout_source(typed, name, description):
+    return '''/*
+ * %s
+ * Generated from XKB symbols by extras/xkb_layout.py
+ */
+
+#include "keyboard.h"
+#include "KeyboardLayout.h"
+
+extern const uint8_t KeyboardLayout_%s[128] PROGMEM =
+{
+#include "layouts/%s.h"
+};
+
+// Characters beyond ASCII, and ASCII characters which need a dead key, sorted by code point
+extern const UnicodeKey KeyboardUnicode_%s[] PROGMEM =
+{
+%s
+\t{0, 0, 0}
+};
+''' % (description, name, name, name, '\n'.join(unicode_rows(typed)))
+
+
+def report(typed, unencodable, check):
+    missing = [chr(i) for i in range(0x20, 0x7f) if chr(i) not in typed]
+    print('Printable ASCII not in the layout: %s' % (' '.join(describe(c) for c in missing) or 'none'))
+
+    unencodable = [c for c in dict(unencodable) if c not in typed]
+    if unencodable:
+        print('On the keyboard, but not supported (Shift + AltGr, or AltGr with a key beyond 0x3f): %s'
+              % ' '.join(describe(c) for c in unencodable))
+
+    wide = [c for c in typed if ord(c) > 0xffff]
+    if wide:
+        print('Beyond U+FFFF, not supported: %s' % ' '.join(wide))
+
+    if check:
+        with open(check, encoding='utf-8') as f:
+            text = f.read()
+        absent = sorted(set(c for c in text if c not in typed and c not in '\r\n\t\b'), key=ord)
+        print('%s: %s' % (check, 'every character can be typed' if not absent else
+                          'can\'t type ' + ' '.join('U+%04X %s' % (ord(c), c) for c in absent)))
+
+    print('%d characters in all, %d through dead keys' % (len(typed), sum(1 for k, d in typed.values() if d)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate an unoHID keyboard layout from an XKB symbols file')
+    parser.add_argument('name', help='layout suffix, e.g. de_DE')
+    parser.add_argument('symbols', help='XKB symbols file, e.g. /usr/share/X11/xkb/symbols/de')
+    parser.add_argument('--variant', help='xkb_symbols section (default: the file\'s default)')
+    parser.add_argument('--include', default='pc', metavar='SYMBOLS',
+                        help='symbols loaded before the layout, as the XKB rules add them, e.g. "pc+inet(evdev)". '
+                             '"" for none (default: %(default)s, which has <LSGT> and the space bar)')
+    parser.add_argument('--description', default=None, help='first line of the generated files')
+    parser.add_argument('--output', help='directory to write to (src/keyboard). Default: report only')
+    parser.add_argument('--check', metavar='FILE', help='UTF-8 text to check against the layout')
+    parser.add_argument('--keysymdef', default='/usr/include/X11/keysymdef.h',
+                        help='keysym names beyond Latin-1 (default: %(default)s)')
+    args = parser.parse_args()
+
+    symbols = Symbols(os.path.dirname(os.path.abspath(args.symbols)))
+    if args.include:
+        symbols.parse('include "%s"' % args.include, 'override')
+    symbols.load(args.symbols, args.variant)
+    typed, unencodable = build(symbols, load_keysyms(args.keysymdef))
+
+    if args.output:
+        description = args.description or '%s keyboard layout.' % args.name
+        os.makedirs(os.path.join(args.output, 'layouts'), exist_ok=True)
+        with open(os.path.join(args.output, 'layouts', args.name + '.h'), 'w', encoding='utf-8') as f:
+            f.write(ascii_fragment(typed, args.name, description))
+        with open(os.path.join(args.output, 'KeyboardLayout_%s.cpp' % args.name), 'w', encoding='utf-8') as f:
+            f.write(layout_source(typed, args.name, description))
+
+    report(typed, unencodable, args.check)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -2,15 +2,20 @@
   KeyboardLayout.h
 
   This file is not part of the public API. It is meant to be included
-  only in Keyboard.cpp and the keyboard layout files. Layout files map
-  ASCII character codes to keyboard scan codes (technically, to USB HID
-  Usage codes), possibly altered by the SHIFT or ALT_GR modifiers.
+  only in Keyboard.cpp, hid_str.h and the keyboard layout files. Layout
+  files map ASCII character codes to keyboard scan codes (technically,
+  to USB HID Usage codes), possibly altered by the SHIFT or ALT_GR
+  modifiers.
 
   == Creating your own layout ==
 
-  In order to create your own layout file, copy an existing layout that
-  is similar to yours, then modify it to use the correct keys. The
-  layout is an array in ASCII order. Each entry contains a scan code,
+  The easiest way is to generate one from an XKB symbols file, with
+  extras/xkb_layout.py (see its description). Otherwise, in order to
+  create your own layout file, copy an existing layout that is similar
+  to yours, then modify it to use the correct keys. The
+  entries live in layouts/xx_YY.h, which is included both by the layout
+  file and by hid_str.h (compile-time strings). The layout is an array
+  in ASCII order. Each entry contains a scan code,
   possibly modified by "|SHIFT" or "|ALT_GR", as in this excerpt from
   the Italian layout:
 
@@ -45,6 +50,8 @@
 
     extern const uint8_t KeyboardLayout_xx_YY[];
 
+  and add a matching struct to hid_str.h, for HID_STR(..., xx_YY).
+
   == Encoding details ==
 
   All scan codes are less than 0x80, which makes bit 7 available to
@@ -2,137 +2,82 @@
  * Danish keyboard layout.
  */
 
+#include "keyboard.h"
 #include "KeyboardLayout.h"
 
 extern const uint8_t KeyboardLayout_da_DK[128] PROGMEM =
 {
-	0x00,          // NUL
-	0x00,          // SOH
-	0x00,          // STX
-	0x00,          // ETX
-	0x00,          // EOT
-	0x00,          // ENQ
-	0x00,          // ACK
-	0x00,          // BEL
-	0x2a,          // BS  Backspace
-	0x2b,          // TAB Tab
-	0x28,          // LF  Enter
-	0x00,          // VT
-	0x00,          // FF
-	0x00,          // CR
-	0x00,          // SO
-	0x00,          // SI
-	0x00,          // DEL
-	0x00,          // DC1
-	0x00,          // DC2
-	0x00,          // DC3
-	0x00,          // DC4
-	0x00,          // NAK
-	0x00,          // SYN
-	0x00,          // ETB
-	0x00,          // CAN
-	0x00,          // EM
-	0x00,          // SUB
-	0x00,          // ESC
-	0x00,          // FS
-	0x00,          // GS
-	0x00,          // RS
-	0x00,          // US
+#include "layouts/da_DK.h"
+};
 
-	0x2c,          // ' '
-	0x1e|SHIFT,    // !
-	0x1f|SHIFT,    // "
-	0x20|SHIFT,    // #
-	0x21|ALT_GR,   // $
-	0x22|SHIFT,    // %
-	0x23|SHIFT,    // &
-	0x31,          // '
-	0x25|SHIFT,    // (
-	0x26|SHIFT,    // )
-	0x31|SHIFT,    // *
-	0x2d,          // +
-	0x36,          // ,
-	0x38,          // -
-	0x37,          // .
-	0x24|SHIFT,    // /
-	0x27,          // 0
-	0x1e,          // 1
-	0x1f,          // 2
-	0x20,          // 3
-	0x21,          // 4
-	0x22,          // 5
-	0x23,          // 6
-	0x24,          // 7
-	0x25,          // 8
-	0x26,          // 9
-	0x37|SHIFT,    // :
-	0x36|SHIFT,    // ;
-	0x32,          // <
-	0x27|SHIFT,    // =
-	0x32|SHIFT,    // >
-	0x2d|SHIFT,    // ?
-	0x1f|ALT_GR,   // @
-	0x04|SHIFT,    // A
-	0x05|SHIFT,    // B
-	0x06|SHIFT,    // C
-	0x07|SHIFT,    // D
-	0x08|SHIFT,    // E
-	0x09|SHIFT,    // F
-	0x0a|SHIFT,    // G
-	0x0b|SHIFT,    // H
-	0x0c|SHIFT,    // I
-	0x0d|SHIFT,    // J
-	0x0e|SHIFT,    // K
-	0x0f|SHIFT,    // L
-	0x10|SHIFT,    // M
-	0x11|SHIFT,    // N
-	0x12|SHIFT,    // O
-	0x13|SHIFT,    // P
-	0x14|SHIFT,    // Q
-	0x15|SHIFT,    // R
-	0x16|SHIFT,    // S
-	0x17|SHIFT,    // T
-	0x18|SHIFT,    // U
-	0x19|SHIFT,    // V
-	0x1a|SHIFT,    // W
-	0x1b|SHIFT,    // X
-	0x1c|SHIFT,    // Y
-	0x1d|SHIFT,    // Z
-	0x25|ALT_GR,   // [
-	0x32|ALT_GR,   // bslash
-	0x26|ALT_GR,   // ]
-	0x00,          // ^  not supported (requires dead key + space)
-	0x38|SHIFT,    // _
-	0x00,          // `  not supported (requires dead key + space)
-	0x04,          // a
-	0x05,          // b
-	0x06,          // c
-	0x07,          // d
-	0x08,          // e
-	0x09,          // f
-	0x0a,          // g
-	0x0b,          // h
-	0x0c,          // i
-	0x0d,          // j
-	0x0e,          // k
-	0x0f,          // l
-	0x10,          // m
-	0x11,          // n
-	0x12,          // o
-	0x13,          // p
-	0x14,          // q
-	0x15,          // r
-	0x16,          // s
-	0x17,          // t
-	0x18,          // u
-	0x19,          // v
-	0x1a,          // w
-	0x1b,          // x
-	0x1c,          // y
-	0x1d,          // z
-	0x24|ALT_GR,   // {
-	0x2e|ALT_GR,   // |
-	0x27|ALT_GR,   // }
-	0x00,          // ~  not supported (requires dead key + space)
-	0x00           // DEL
+// Characters beyond ASCII, and ASCII characters which need a dead key, sorted by code point
+extern const UnicodeKey KeyboardUnicode_da_DK[] PROGMEM =
+{
+	{0x005e, 0x2c,         0x30|SHIFT },  // ^  dead key + space
+	{0x0060, 0x2c,         0x2e|SHIFT },  // `  dead key + space
+	{0x007e, 0x2c,         0x30|ALT_GR},  // ~  dead key + space
+	{0x00a3, 0x20|ALT_GR,  0          },  // £
+	{0x00a4, 0x21|SHIFT,   0          },  // ¤
+	{0x00a7, 0x35|SHIFT,   0          },  // §
+	{0x00a8, 0x2c,         0x30       },  // ¨  dead key + space
+	{0x00b4, 0x2c,         0x2e       },  // ´  dead key + space
+	{0x00b5, 0x10|ALT_GR,  0          },  // µ
+	{0x00bd, 0x35,         0          },  // ½
+	{0x00c0, 0x04|SHIFT,   0x2e|SHIFT },  // À
+	{0x00c1, 0x04|SHIFT,   0x2e       },  // Á
+	{0x00c2, 0x04|SHIFT,   0x30|SHIFT },  // Â
+	{0x00c3, 0x04|SHIFT,   0x30|ALT_GR},  // Ã
+	{0x00c4, 0x04|SHIFT,   0x30       },  // Ä
+	{0x00c5, 0x2f|SHIFT,   0          },  // Å
+	{0x00c6, 0x33|SHIFT,   0          },  // Æ
+	{0x00c8, 0x08|SHIFT,   0x2e|SHIFT },  // È
+	{0x00c9, 0x08|SHIFT,   0x2e       },  // É
+	{0x00ca, 0x08|SHIFT,   0x30|SHIFT },  // Ê
+	{0x00cb, 0x08|SHIFT,   0x30       },  // Ë
+	{0x00cc, 0x0c|SHIFT,   0x2e|SHIFT },  // Ì
+	{0x00cd, 0x0c|SHIFT,   0x2e       },  // Í
+	{0x00ce, 0x0c|SHIFT,   0x30|SHIFT },  // Î
+	{0x00cf, 0x0c|SHIFT,   0x30       },  // Ï
+	{0x00d1, 0x11|SHIFT,   0x30|ALT_GR},  // Ñ
+	{0x00d2, 0x12|SHIFT,   0x2e|SHIFT },  // Ò
+	{0x00d3, 0x12|SHIFT,   0x2e       },  // Ó
+	{0x00d4, 0x12|SHIFT,   0x30|SHIFT },  // Ô
+	{0x00d5, 0x12|SHIFT,   0x30|ALT_GR},  // Õ
+	{0x00d6, 0x12|SHIFT,   0x30       },  // Ö
+	{0x00d8, 0x34|SHIFT,   0          },  // Ø
+	{0x00d9, 0x18|SHIFT,   0x2e|SHIFT },  // Ù
+	{0x00da, 0x18|SHIFT,   0x2e       },  // Ú
+	{0x00db, 0x18|SHIFT,   0x30|SHIFT },  // Û
+	{0x00dc, 0x18|SHIFT,   0x30       },  // Ü
+	{0x00dd, 0x1c|SHIFT,   0x2e       },  // Ý
+	{0x00e0, 0x04,         0x2e|SHIFT },  // à
+	{0x00e1, 0x04,         0x2e       },  // á
+	{0x00e2, 0x04,         0x30|SHIFT },  // â
+	{0x00e3, 0x04,         0x30|ALT_GR},  // ã
+	{0x00e4, 0x04,         0x30       },  // ä
+	{0x00e5, 0x2f,         0          },  // å
+	{0x00e6, 0x33,         0          },  // æ
+	{0x00e8, 0x08,         0x2e|SHIFT },  // è
+	{0x00e9, 0x08,         0x2e       },  // é
+	{0x00ea, 0x08,         0x30|SHIFT },  // ê
+	{0x00eb, 0x08,         0x30       },  // ë
+	{0x00ec, 0x0c,         0x2e|SHIFT },  // ì
+	{0x00ed, 0x0c,         0x2e       },  // í
+	{0x00ee, 0x0c,         0x30|SHIFT },  // î
+	{0x00ef, 0x0c,         0x30       },  // ï
+	{0x00f1, 0x11,         0x30|ALT_GR},  // ñ
+	{0x00f2, 0x12,         0x2e|SHIFT },  // ò
+	{0x00f3, 0x12,         0x2e       },  // ó
+	{0x00f4, 0x12,         0x30|SHIFT },  // ô
+	{0x00f5, 0x12,         0x30|ALT_GR},  // õ
+	{0x00f6, 0x12,         0x30       },  // ö
+	{0x00f8, 0x34,         0          },  // ø
+	{0x00f9, 0x18,         0x2e|SHIFT },  // ù
+	{0x00fa, 0x18,         0x2e       },  // ú
+	{0x00fb, 0x18,         0x30|SHIFT },  // û
+	{0x00fc, 0x18,         0x30       },  // ü
+	{0x00fd, 0x1c,         0x2e       },  // ý
+	{0x00ff, 0x1c,         0x30       },  // ÿ
+	{0x20ac, 0x08|ALT_GR,  0          },  // €
+	{0, 0, 0}
 };
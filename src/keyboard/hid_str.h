@@ -0,0 +1,130 @@
+#ifndef __HID_STR_H__
+#define __HID_STR_H__
+
+#include <Arduino.h>
+
+/*
+  Compile-time keystrokes.
+
+  HID_STR("text", layout) works out the keys for each character of a string literal while the sketch
+  compiles, and stores them in flash as (modifiers, usage) pairs. Keyboard.type() then streams them
+  as they are, with no layout lookup at run time:
+
+      Keyboard.type(HID_STR("Hello, World!\n", en_US));
+      Keyboard.type(HID_STR("Grosse Wiese", de_DE));
+
+  The layout is the suffix of a KeyboardLayout_xx_YY table. A character the layout can't produce
+  stops the build (the compiler's notes name it), instead of setting a write error at run time.
+*/
+
+#define HID_STR_MAX_LENGTH 64
+
+// One character: the modifiers to hold, and the key
+struct HIDKeystroke {
+  uint8_t modifiers;    // Left Shift or Right Alt (AltGr), plus HID_STR_LETTER
+  uint8_t usage;        // 0: nothing to type ('\r' is skipped, as by print())
+};
+
+// Marks letters, which follow Caps Lock. Right GUI is never part of a character, so its bit is free
+#define HID_STR_LETTER 0x80
+
+// A compiled string: its keystrokes, in flash
+struct HIDString {
+  const HIDKeystroke *keys;
+  uint16_t length;
+};
+
+// Layout encoding (KeyboardLayout.h), for this file only: it isn't part of the public API
+#pragma push_macro("SHIFT")
+#pragma push_macro("ALT_GR")
+#pragma push_macro("ISO_KEY")
+#pragma push_macro("ISO_REPLACEMENT")
+#include "KeyboardLayout.h"
+
+namespace HIDStr {
+
+// The layouts, where the compiler can read them. Same entries as KeyboardLayout_xx_YY
+struct da_DK { static constexpr uint8_t table[128] = {
+#include "layouts/da_DK.h"
+}; };
+struct de_DE { static constexpr uint8_t table[128] = {
+#include "layouts/de_DE.h"
+}; };
+struct en_US { static constexpr uint8_t table[128] = {
+#include "layouts/en_US.h"
+}; };
+struct es_ES { static constexpr uint8_t table[128] = {
+#include "layouts/es_ES.h"
+}; };
+struct fr_FR { static constexpr uint8_t table[128] = {
+#include "layouts/fr_FR.h"
+}; };
+struct it_IT { static constexpr uint8_t table[128] = {
+#include "layouts/it_IT.h"
+}; };
+struct sv_SE { static constexpr uint8_t table[128] = {
+#include "layouts/sv_SE.h"
+}; };
+
+// Decoding of a layout entry, as Keyboard_::toKeystroke() does it at run time
+constexpr bool isAltGr(uint8_t entry) { return (entry & ALT_GR) == ALT_GR; }
+constexpr uint8_t scanCode(uint8_t entry) { return isAltGr(entry) ? entry & 0x3F : entry & 0x7F; }
+constexpr uint8_t usageOf(uint8_t entry) { return scanCode(entry) == ISO_REPLACEMENT ? ISO_KEY : scanCode(entry); }
+constexpr uint8_t modifiersOf(uint8_t entry) { return isAltGr(entry) ? 0x40 : (entry & SHIFT) ? 0x02 : 0; }
+constexpr bool isLetter(char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+
+// One character under one layout. Instantiated per character, so a failure names it
+template <typename Layout, char C>
+struct Key {
+  static_assert(C >= 0 && (Layout::table[C >= 0 ? C : 0] || C == '\r'),
+                "HID_STR: the layout has no key for this character (named in the notes above)");
+
+  static constexpr uint8_t entry = (C >= 0) ? Layout::table[C >= 0 ? C : 0] : 0;
+  static constexpr uint8_t modifiers = modifiersOf(entry) | (isLetter(C) ? HID_STR_LETTER : 0);
+  static constexpr uint8_t usage = usageOf(entry);
+};
+
+// 0, 1, ... N-1
+template <unsigned... I> struct Indices {};
+template <unsigned N, unsigned... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template <unsigned... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+// The first length characters of the padded string, compiled
+template <typename Layout, typename Indices, char... Text> struct Compiled;
+
+template <typename Layout, unsigned... I, char... Text>
+struct Compiled<Layout, Indices<I...>, Text...> {
+  static constexpr char text[sizeof...(Text)] = { Text... };
+  static constexpr HIDKeystroke keys[sizeof...(I)] PROGMEM = { { Key<Layout, text[I]>::modifiers, Key<Layout, text[I]>::usage }... };
+
+  static HIDString string() { return { keys, sizeof...(I) }; }
+};
+
+template <typename Layout, unsigned... I, char... Text>
+constexpr HIDKeystroke Compiled<Layout, Indices<I...>, Text...>::keys[sizeof...(I)] PROGMEM;
+
+template <typename Layout, unsigned Length, char... Text>
+struct Compile {
+  static_assert(Length > 0, "HID_STR: empty string");
+  static_assert(Length <= HID_STR_MAX_LENGTH, "HID_STR: string too long (see HID_STR_MAX_LENGTH)");
+
+  typedef Compiled<Layout, typename MakeIndices<(Length > 0 && Length <= HID_STR_MAX_LENGTH) ? Length : 1>::type, Text...> type;
+};
+
+} // namespace HIDStr
+
+#pragma pop_macro("ISO_REPLACEMENT")
+#pragma pop_macro("ISO_KEY")
+#pragma pop_macro("ALT_GR")
+#pragma pop_macro("SHIFT")
+
+// The string literal, one character at a time, padded with '\0' to HID_STR_MAX_LENGTH
+#define HID_STR_AT(s, i)  ((i) < sizeof(s) ? (s)[(i) < sizeof(s) ? (i) : 0] : '\0')
+#define HID_STR_8(s, i)   HID_STR_AT(s, i), HID_STR_AT(s, i + 1), HID_STR_AT(s, i + 2), HID_STR_AT(s, i + 3), \
+                          HID_STR_AT(s, i + 4), HID_STR_AT(s, i + 5), HID_STR_AT(s, i + 6), HID_STR_AT(s, i + 7)
+#define HID_STR_64(s)     HID_STR_8(s, 0), HID_STR_8(s, 8), HID_STR_8(s, 16), HID_STR_8(s, 24), \
+                          HID_STR_8(s, 32), HID_STR_8(s, 40), HID_STR_8(s, 48), HID_STR_8(s, 56)
+
+#define HID_STR(s, layout) (HIDStr::Compile<HIDStr::layout, sizeof(s) - 1, HID_STR_64(s)>::type::string())
+
+#endif // __HID_STR_H__
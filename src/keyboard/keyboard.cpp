@@ -19,6 +19,7 @@
   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include <avr/eeprom.h>
 #include "keyboard.h"
 #include "KeyboardLayout.h"
 #include "Keyboard_de_DE.h"
@@ -26,12 +27,18 @@
 Keyboard_::Keyboard_(VUSBController *vusb) {
     _asciimap = KeyboardLayout_en_US;
 
+#if USB_COUNT_SOF
+    tx_delay = 0;       // Start-of-frame pacing already guarantees one report per host poll
+#else
+    tx_delay = 20;
+#endif
+
     // Store reference to the VUSB controller
     this->vusb = vusb;
 }
 
-void Keyboard_::begin(const uint8_t *layout) {
-    _asciimap = layout;
+void Keyboard_::begin(const uint8_t *layout, const UnicodeKey *unicode) {
+    setLayout(layout, unicode);
 
     // Tell the VUSB controller to start up, if not already started by mouse
     vusb->keyboardOn();
@@ -42,149 +49,658 @@ void Keyboard_::end(void) {
     vusb->keyboardOff();
 }
 
+// The layout only turns characters into keys, on the way into the queue: it can change at any time,
+// with no need to reconnect. Keys held with press() stay held, so release them under the layout they were pressed with
+void Keyboard_::setLayout(const uint8_t *layout, const UnicodeKey *unicode) {
+    _asciimap = layout;
+    _unicode = unicode;
+    _unicodeCount = 0;
+    while (unicode && pgm_read_word(&unicode[_unicodeCount].codepoint))
+        _unicodeCount++;
+}
 
-void Keyboard_::sendReport(KeyReport* keys) {
-    // This method rewritten to use VUSB
-    vusb->pausePolling();   // No auto-polling with timer
+const uint8_t* Keyboard_::getLayout() {
+    return _asciimap;
+}
 
-    // See if we are ready to use USB
-    for ( uint16_t i = 0; i < 5000; i += 15 ) {
-        usbPoll();
-        if (usbInterruptIsReady()) {
-            // Send the report
-            usbSetInterrupt( (uchar*) keys, 8);
-            break;
+size_t Keyboard_::printIn(const uint8_t *layout, const char *text, const UnicodeKey *unicode) {
+    const uint8_t *previous = _asciimap;
+    const UnicodeKey *previous_unicode = _unicode;
+    setLayout(layout, unicode);
+    size_t n = print(text);
+    setLayout(previous, previous_unicode);
+    return n;
+}
+
+size_t Keyboard_::printIn(const uint8_t *layout, const __FlashStringHelper *text, const UnicodeKey *unicode) {
+    const uint8_t *previous = _asciimap;
+    const UnicodeKey *previous_unicode = _unicode;
+    setLayout(layout, unicode);
+    size_t n = print(text);
+    setLayout(previous, previous_unicode);
+    return n;
+}
+
+
+ReportHandle Keyboard_::sendReport(KeyReport* keys) {
+    // Snapshot the report; the controller sends it in the background
+    ReportHandle handle = vusb->queueReport(VUSBController::KeyboardInterface, (uint8_t*) keys, sizeof(KeyReport), tx_delay);
+    if (!handle)
+        setWriteError();    // Host stopped collecting reports
+
+    return handle;
+}
+
+// N-key rollover: send the parts of the bitmap which changed (bit 0 of segments: report ID 6, ...)
+// Only the last report is held for tx_delay; the others go out on the next polls.
+// Returns the handle of the last report.
+ReportHandle Keyboard_::sendNKRO(uint8_t segments) {
+    static const uint8_t first_byte[NKRO_SEGMENTS + 1] = {0, 6, 13, 15};    // Which bitmap bytes go in which report
+
+    if (!segments)
+        segments = 1 << 0;  // Nothing changed, but the caller still wants a handle
+
+    uint8_t keys[sizeof(_keys)];
+    memcpy(keys, _keys, sizeof(keys));
+    if (_typedUsage)
+        keys[_typedUsage >> 3] |= 1 << (_typedUsage & 7);
+
+    ReportHandle handle = 0;
+    for (uint8_t s = 0; s < NKRO_SEGMENTS; s++) {
+        if (!(segments & (1 << s)))
+            continue;
+
+        uint8_t report[8];
+        uint8_t length = 0;
+        report[length++] = NKRO_REPORT_ID + s;
+        if (s == 0)
+            report[length++] = _keyReport.modifiers | _typedModifiers;
+        for (uint8_t i = first_byte[s]; i < first_byte[s + 1]; i++)
+            report[length++] = keys[i];
+
+        segments &= ~(1 << s);
+        uint16_t hold = segments ? 0 : tx_delay;
+        handle = vusb->queueReport(VUSBController::KeyboardInterface, report, length, hold);
+        if (!handle) {
+            setWriteError();    // Host stopped collecting reports
+            return 0;
         }
-        delay(15);
     }
+    return handle;
+}
 
-    delay(tx_delay);
-    vusb->resumePolling();
+// Which N-key rollover reports a change to these modifiers and this key touches
+uint8_t Keyboard_::nkroSegments(uint8_t modifiers, uint8_t usage) {
+    uint8_t segments = 0;
+    if (modifiers)
+        segments |= 1 << 0;
+    if (usage >= 104)
+        segments |= 1 << 2;
+    else if (usage >= 48)
+        segments |= 1 << 1;
+    else if (usage)
+        segments |= 1 << 0;
+    return segments;
+}
+
+// N-key rollover, unless the keyboard is sending boot reports (BIOS, or USB_BOOT_INTERFACES), which only have the standard report
+bool Keyboard_::useNKRO() {
+    return _nkro && !vusb->bootFormat(VUSBController::KeyboardInterface);
+}
+
+// The most reports one keystroke (or its release) can take
+uint8_t Keyboard_::reportsPerKeystroke() {
+    return useNKRO() ? 2 : 1;
 }
 
 uint8_t USBPutChar(uint8_t c);
 
-// press() adds the specified key (printing, non-printing, or modifier)
-// to the persistent key report and sends the report.  Because of the way
-// USB HID works, the host acts like the key remains pressed until we
-// call release(), releaseAll(), or otherwise clear the report and resend.
-size_t Keyboard_::press(uint8_t k) {
-    uint8_t i;
+// Translate a key (printing, non-printing, or modifier) into a usage code,
+// plus any modifiers needed to produce it on the current layout.
+// Returns false if the layout has no way to type the character.
+bool Keyboard_::toKeystroke(uint8_t k, uint8_t *modifiers, uint8_t *usage) {
+    *modifiers = 0;
     if (k >= 136) {         // it's a non-printing key (not a modifier)
         k = k - 136;
     } else if (k >= 128) {  // it's a modifier key
-        _keyReport.modifiers |= (1<<(k-128));
+        *modifiers = (1<<(k-128));
         k = 0;
     } else {                // it's a printing key
         k = pgm_read_byte(_asciimap + k);
         if (!k) {
-            setWriteError();
-            return 0;
-        }
-        if ((k & ALT_GR) == ALT_GR) {
-            _keyReport.modifiers |= 0x40;   // AltGr = right Alt
-            k &= 0x3F;
-        } else if ((k & SHIFT) == SHIFT) {
-            _keyReport.modifiers |= 0x02;   // the left shift modifier
-            k &= 0x7F;
+            return false;
         }
-        if (k == ISO_REPLACEMENT) {
-            k = ISO_KEY;
+        decodeKey(k, modifiers, &k);
+    }
+    *usage = k;
+    return true;
+}
+
+// A layout entry (KeyboardLayout.h), as a modifier and a key
+void Keyboard_::decodeKey(uint8_t key, uint8_t *modifiers, uint8_t *usage) {
+    *modifiers = 0;
+    if ((key & ALT_GR) == ALT_GR) {
+        *modifiers = 0x40;   // AltGr = right Alt
+        key &= 0x3F;
+    } else if ((key & SHIFT) == SHIFT) {
+        *modifiers = 0x02;   // the left shift modifier
+        key &= 0x7F;
+    }
+    if (key == ISO_REPLACEMENT) {
+        key = ISO_KEY;
+    }
+    *usage = key;
+}
+
+// Binary search of the layout's Unicode table
+bool Keyboard_::findUnicode(uint16_t c, uint8_t *key, uint8_t *dead) {
+    uint16_t low = 0, high = _unicodeCount;
+    while (low < high) {
+        uint16_t middle = (low + high) / 2;
+        uint16_t found = pgm_read_word(&_unicode[middle].codepoint);
+        if (found == c) {
+            *key = pgm_read_byte(&_unicode[middle].key);
+            *dead = pgm_read_byte(&_unicode[middle].dead);
+            return true;
         }
+        if (found < c)
+            low = middle + 1;
+        else
+            high = middle;
     }
+    return false;
+}
 
-    // Add k to the key report only if it's not already present
-    // and if there is an empty slot.
-    if (_keyReport.keys[0] != k && _keyReport.keys[1] != k &&
-        _keyReport.keys[2] != k && _keyReport.keys[3] != k &&
-        _keyReport.keys[4] != k) {
+// Add k to the key report only if it's not already held
+// and if there is an empty slot.
+bool Keyboard_::addKey(KeyReport *report, uint8_t k) {
+    if (k == 0 || isHeld(k))
+        return true;
 
-        for (i=0; i<5; i++) {
-            if (_keyReport.keys[i] == 0x00) {
-                _keyReport.keys[i] = k;
-                break;
-            }
+    for (uint8_t i=0; i<sizeof(report->keys); i++) {
+        if (report->keys[i] == 0x00) {
+            report->keys[i] = k;
+            return true;
         }
-        if (i == 5) {
+    }
+    return false;
+}
+
+// The bitmap of held keys is the source of truth: one bit per usage.
+// The slots of the standard report just follow it.
+bool Keyboard_::isHeld(uint8_t usage) {
+    return _keys[usage >> 3] & (1 << (usage & 7));
+}
+
+// Mark a key (and its modifiers) as held, keeping count
+void Keyboard_::holdKey(uint8_t modifiers, uint8_t usage) {
+    if (modifiers & ~_keyReport.modifiers)     // At most one modifier bit, from toKeystroke()
+        _pressedCount++;
+    _keyReport.modifiers |= modifiers;
+
+    if (usage && !isHeld(usage)) {
+        _keys[usage >> 3] |= 1 << (usage & 7);
+        _pressedCount++;
+    }
+}
+
+void Keyboard_::letGoKey(uint8_t modifiers, uint8_t usage) {
+    if (modifiers & _keyReport.modifiers)
+        _pressedCount--;
+    _keyReport.modifiers &= ~modifiers;
+
+    if (usage && isHeld(usage)) {
+        _keys[usage >> 3] &= ~(1 << (usage & 7));
+        _pressedCount--;
+    }
+}
+
+// press() adds the specified key (printing, non-printing, or modifier)
+// to the persistent key report and sends the report.  Because of the way
+// USB HID works, the host acts like the key remains pressed until we
+// call release(), releaseAll(), or otherwise clear the report and resend.
+// Returns a handle for the report, to check when the host has received it.
+size_t Keyboard_::press(uint8_t k) {
+    uint8_t modifiers;
+    if (!toKeystroke(k, &modifiers, &k)) {
+        setWriteError();
+        return 0;
+    }
+
+    if (useNKRO()) {
+        if (k > NKRO_LAST_USAGE) {
             setWriteError();
             return 0;
         }
+        holdKey(modifiers, k);
+        return sendNKRO(nkroSegments(modifiers, k));
     }
 
-    sendReport(&_keyReport);
-    return 1;
+    // Take a slot, unless the key already has one
+    if (!addKey(&_keyReport, k)) {
+        setWriteError();
+        return 0;
+    }
+
+    holdKey(modifiers, k);
+    return sendReport(&_keyReport);
 }
 
 // release() takes the specified key out of the persistent key report and
 // sends the report.  This tells the OS the key is no longer pressed and that
 // it shouldn't be repeated any more.
 size_t Keyboard_::release(uint8_t k) {
-    uint8_t i;
-    if (k >= 136) {         // it's a non-printing key (not a modifier)
-        k = k - 136;
-    } else if (k >= 128) {  // it's a modifier key
-        _keyReport.modifiers &= ~(1<<(k-128));
-        k = 0;
-    } else {                // it's a printing key
-        k = pgm_read_byte(_asciimap + k);
-        if (!k) {
+    uint8_t modifiers;
+    if (!toKeystroke(k, &modifiers, &k)) {
+        return 0;
+    }
+
+    if (useNKRO()) {
+        if (k > NKRO_LAST_USAGE)
             return 0;
-        }
-        if ((k & ALT_GR) == ALT_GR) {
-            _keyReport.modifiers &= ~(0x40);   // AltGr = right Alt
-            k &= 0x3F;
-        } else if ((k & SHIFT) == SHIFT) {
-            _keyReport.modifiers &= ~(0x02);    // the left shift modifier
-            k &= 0x7F;
-        }
-        if (k == ISO_REPLACEMENT) {
-            k = ISO_KEY;
-        }
+        letGoKey(modifiers, k);
+        return sendNKRO(nkroSegments(modifiers, k));
     }
 
-    // Test the key report to see if k is present.  Clear it if it exists.
-    // Check all positions in case the key is present more than once (which it shouldn't be)
-    for (i=0; i<5; i++) {
-        if (0 != k && _keyReport.keys[i] == k) {
-            _keyReport.keys[i] = 0x00;
+    // Free the key's slot. Only held keys have one, so most releases skip the search
+    if (k && isHeld(k)) {
+        for (uint8_t i=0; i<sizeof(_keyReport.keys); i++) {
+            if (_keyReport.keys[i] == k)
+                _keyReport.keys[i] = 0x00;
         }
     }
 
-    sendReport(&_keyReport);
-    return 1;
+    letGoKey(modifiers, k);
+    return sendReport(&_keyReport);
+}
+
+// Streaming typing: go straight from one keystroke to the next in a single report.
+// A release is only sent when the host couldn't otherwise tell the keystrokes apart:
+// the same key twice in a row, or a change of modifiers (e.g. "a" followed by "B").
+// Keys held with press() stay held throughout.
+bool Keyboard_::typeKeystroke(uint8_t modifiers, uint8_t usage) {
+    if (needsRelease(modifiers, usage))
+        releaseTyped();
+
+    if (useNKRO()) {
+        if (usage > NKRO_LAST_USAGE)
+            return false;
+
+        // Let go of the previous key and press this one, in as few reports as possible
+        uint8_t segments = nkroSegments(_typedModifiers, _typedUsage) | nkroSegments(modifiers, usage);
+        _typedUsage = usage;
+        _typedModifiers = modifiers;
+        return sendNKRO(segments) != 0;
+    }
+
+    KeyReport report = _keyReport;
+    report.modifiers |= modifiers;
+    if (!addKey(&report, usage)) {
+        releaseTyped();
+        return false;
+    }
+
+    _typedUsage = usage;
+    _typedModifiers = modifiers;
+    return sendReport(&report) != 0;
+}
+
+// Would typeKeystroke() have to let go of the previous key first?
+bool Keyboard_::needsRelease(uint8_t modifiers, uint8_t usage) {
+    bool typing = (_typedUsage || _typedModifiers);
+    return typing && (usage == _typedUsage || modifiers != _typedModifiers);
+}
+
+// Let go of whatever typeKeystroke() left pressed. Returns the handle of the release, or 0 if nothing was pressed
+ReportHandle Keyboard_::releaseTyped() {
+    if (!_typedUsage && !_typedModifiers)
+        return 0;
+
+    uint8_t segments = nkroSegments(_typedModifiers, _typedUsage);
+    _typedUsage = 0;
+    _typedModifiers = 0;
+    if (useNKRO())
+        return sendNKRO(segments);
+    else
+        return sendReport(&_keyReport);
 }
 
 void Keyboard_::releaseAll(void) {
-    _keyReport.keys[0] = 0;
-    _keyReport.keys[1] = 0;
-    _keyReport.keys[2] = 0;
-    _keyReport.keys[3] = 0;
-    _keyReport.keys[4] = 0;
+    memset(_keyReport.keys, 0, sizeof(_keyReport.keys));
     _keyReport.modifiers = 0;
-    sendReport(&_keyReport);
+    memset(_keys, 0, sizeof(_keys));
+    _pressedCount = 0;
+    if (useNKRO())
+        sendNKRO((1 << NKRO_SEGMENTS) - 1);     // Unchanged reports are skipped by the controller
+    else
+        sendReport(&_keyReport);
 }
 
+// Type one key, through the same engine as write(buffer, size). Keys held with press() stay held
 size_t Keyboard_::write(uint8_t c) {
-    uint8_t p = press(c);   // Keydown
-    release(c);     // Keyup
-    return p;       // just return the result of press() since release() almost always returns 1
+    uint8_t modifiers, usage;
+    if (!toKeystroke(c, &modifiers, &usage)) {
+        setWriteError();
+        return 0;
+    }
+
+    bool typed = typeNext(modifiers, usage, c < 128 && isLetter(c));
+    releaseTyped();
+    return typed ? 1 : 0;
 }
 
+// Type a whole buffer through the streaming engine: roughly one report per character, instead of two
+// Non-blocking (see setBlocking): stops when the queue is full, and returns how many characters were typed.
+// The sketch can try again later with the rest, as with Serial.
 size_t Keyboard_::write(const uint8_t *buffer, size_t size) {
+    size_t n = typeChars(buffer, size);
+    releaseTyped();
+    return n;
+}
+
+// The body of write(buffer, size): UTF-8 text. The last key is left pressed, so the next call can carry straight on.
+// A character cut off at the end of the buffer isn't typed (or counted): the next call can start with it
+size_t Keyboard_::typeChars(const uint8_t *buffer, size_t size) {
     size_t n = 0;
-    while (size--) {
-        if (*buffer != '\r') {
-            if (write(*buffer)) {
-                n++;
-            } else {
-                break;
-            }
+    while (n < size) {
+        uint8_t c = buffer[n];
+        uint8_t length = (c < 0xc0) ? 1 : (c < 0xe0) ? 2 : (c < 0xf0) ? 3 : 4;
+        if (n + length > size)
+            break;
+
+        // Decode. Stray continuation bytes, and code points past 0xFFFF, become 0xFFFF: never in a layout
+        uint16_t codepoint = (c < 0x80) ? c : (c < 0xc0 || length == 4) ? 0xFFFF : c & (0x3f >> (length - 1));
+        for (uint8_t i = 1; i < length; i++) {
+            if ((buffer[n + i] & 0xc0) != 0x80)
+                codepoint = 0xFFFF;
+            else if (codepoint != 0xFFFF)
+                codepoint = (codepoint << 6) | (buffer[n + i] & 0x3f);
         }
-        buffer++;
+
+        if (codepoint != '\r' && !typeCharacter(codepoint))   // '\r' is skipped, but counted: the sketch can resume from buffer + n
+            break;
+        n += length;
+    }
+    return n;
+}
+
+// One character of text: from the layout, or else from its Unicode table (maybe after a dead key)
+bool Keyboard_::typeCharacter(uint16_t c) {
+    uint8_t key = (c < 128) ? pgm_read_byte(_asciimap + c) : 0;
+    uint8_t dead = 0;
+    if (!key && !findUnicode(c, &key, &dead)) {
+        setWriteError();
+        return false;
+    }
+
+    uint8_t modifiers, usage, deadModifiers, deadUsage;
+    decodeKey(key, &modifiers, &usage);
+    decodeKey(dead, &deadModifiers, &deadUsage);
+    return typeNext(modifiers, usage, isLetter(c), deadModifiers, deadUsage);
+}
+
+// Text from elsewhere than RAM goes through a small window on the stack, so it can be any length.
+// The engine runs on from one window to the next, as if the text were one buffer. A UTF-8 character
+// cut off at the end of a window is read again, at the start of the next.
+// Returns how many characters were typed: the sketch can resume from there (non-blocking, see write())
+size_t Keyboard_::typeFrom(TextReader reader, void *context) {
+    uint8_t window[TYPE_WINDOW];
+    size_t n = 0;
+    uint8_t length;
+    while ((length = reader(context, n, window, sizeof(window))) > 0) {
+        size_t typed = typeChars(window, length);
+        n += typed;
+        if (!typed)
+            break;      // Stopped (see write), or the text ends part way through a character
+    }
+    releaseTyped();
+    return n;
+}
+
+size_t Keyboard_::typeFlash(const char *text) {
+    return typeFrom(readFlash, (void *) text);
+}
+
+size_t Keyboard_::print(const __FlashStringHelper *text) {
+    return typeFlash((const char *) text);
+}
+
+size_t Keyboard_::println(const __FlashStringHelper *text) {
+    size_t n = print(text);
+    n += println();
+    return n;
+}
+
+// Up to the string's '\0'
+uint8_t Keyboard_::readFlash(void *context, size_t offset, uint8_t *buffer, uint8_t size) {
+    const char *text = (const char *) context + offset;
+    uint8_t n = 0;
+    while (n < size && (buffer[n] = pgm_read_byte(text + n)))
+        n++;
+    return n;
+}
+
+// Where the text is in EEPROM
+struct EEPROMText {
+    uint16_t address;
+    size_t length;
+};
+
+size_t Keyboard_::typeEEPROM(uint16_t address, size_t length) {
+    EEPROMText text = {address, length};
+    return typeFrom(readEEPROM, &text);
+}
+
+uint8_t Keyboard_::readEEPROM(void *context, size_t offset, uint8_t *buffer, uint8_t size) {
+    EEPROMText *text = (EEPROMText *) context;
+    uint8_t n = 0;
+    while (n < size && offset + n < text->length &&
+           (buffer[n] = eeprom_read_byte((const uint8_t *) (text->address + offset + n))))
+        n++;
+    return n;
+}
+
+// Type a string compiled by HID_STR: the keystrokes are already worked out, so they go straight to the engine.
+// Returns how many characters were typed, as write(buffer, size) does
+size_t Keyboard_::type(const HIDString &text) {
+    size_t n = 0;
+    for (; n < text.length; n++) {
+        uint8_t modifiers = pgm_read_byte(&text.keys[n].modifiers);
+        uint8_t usage = pgm_read_byte(&text.keys[n].usage);
+        if (usage && !typeNext(modifiers & ~HID_STR_LETTER, usage, modifiers & HID_STR_LETTER))
+            break;
     }
+    releaseTyped();
     return n;
 }
 
+// One character of write() or type(), after its dead key if it has one (deadUsage).
+// The two go together: nothing comes between them, not even a verified typing checkpoint.
+// False: stop typing, for now (non-blocking) or because of an error
+bool Keyboard_::typeNext(uint8_t modifiers, uint8_t usage, bool letter, uint8_t deadModifiers, uint8_t deadUsage) {
+    followCapsLock(letter, &modifiers);
+    if (!verify())
+        return false;
+
+    // Room for the keystrokes (each maybe after a release), plus the final release
+    if (!_blocking) {
+        bool release = deadUsage ? needsRelease(deadModifiers, deadUsage) : needsRelease(modifiers, usage);
+        uint8_t needed = ((release ? 1 : 0) + (deadUsage ? 4 : 2)) * reportsPerKeystroke();
+        if (vusb->available(VUSBController::KeyboardInterface) < needed)
+            return false;
+    }
+
+    if ((deadUsage && !typeKeystroke(deadModifiers, deadUsage)) || !typeKeystroke(modifiers, usage)) {
+        setWriteError();
+        return false;
+    }
+    _sinceCheck++;
+    return true;
+}
+
+// Is the key held, by press()? Keys typed by print() and write() don't count
+bool Keyboard_::isPressed(uint8_t k) {
+    uint8_t modifiers, usage;
+    if (!toKeystroke(k, &modifiers, &usage))
+        return false;
+
+    return (_keyReport.modifiers & modifiers) == modifiers && (!usage || isHeld(usage));
+}
+
+// Number of keys held by press(), modifiers included
+uint8_t Keyboard_::pressedCount() {
+    return _pressedCount;
+}
+
+// With Caps Lock on, the host inverts Shift for letters. Typing inverts it too, so the text comes out as written.
+// press() is left alone: a held key should stay the same key.
+void Keyboard_::followCapsLock(bool letter, uint8_t *modifiers) {
+    if (!(vusb->ledStatus() & LED_CAPS_LOCK))
+        return;
+
+    if (letter && (*modifiers & ~0x02) == 0)    // Not AltGr combinations
+        *modifiers ^= 0x02;
+}
+
+// Letters follow Caps Lock: a - z, and the Latin-1 letters (except ß)
+bool Keyboard_::isLetter(uint16_t c) {
+    if (c >= 0xc0 && c <= 0xfe)
+        return c != 0xd7 && c != 0xdf && c != 0xf7;
+    return (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+}
+
+// Verified typing: some hosts lose keystrokes if they arrive faster than the OS can take them.
+// Every _verifyEvery characters, tap Scroll Lock twice. The host answers each tap with an LED report, but only once
+// it has worked through everything typed before. A quick answer means the host is keeping up: type faster.
+// A slow answer means it is falling behind: back off.
+#define VERIFY_FAST         20      // ms from the checkpoint reaching the host, to its answer
+#define VERIFY_SLOW         60
+#define VERIFY_TIMEOUT      500     // No answer at all: this host doesn't report Scroll Lock (e.g. macOS)
+#define VERIFY_MAX_DELAY    100     // Slowest tx_delay verified typing will back off to
+
+void Keyboard_::setVerifiedTyping(uint8_t every) {
+    if (_verifyEvery && !every)
+        tx_delay = _baseDelay;
+    else if (!_verifyEvery && every)
+        _baseDelay = tx_delay;
+
+    _verifyEvery = every;
+    _sinceCheck = 0;
+    _echoPending = false;
+}
+
+// Before each character: start a checkpoint if one is due. Only one is in flight at a time, so typing
+// runs ahead of the host by at most _verifyEvery characters. False: not ready yet (non-blocking only)
+bool Keyboard_::verify() {
+    if (!_verifyEvery)
+        return true;
+
+    bool waiting = awaitingEcho();  // Also notes the timing, as early as possible
+    if (!_verifyEvery)
+        return true;                // Gave up waiting, and switched itself off
+    if (_sinceCheck < _verifyEvery)
+        return true;
+
+    while (waiting) {
+        if (!_blocking)
+            return false;
+        vusb->pollIfManual();
+        waiting = awaitingEcho();
+        if (!_verifyEvery)
+            return true;
+    }
+
+    // Two taps, each a press and a release, after letting go of the last character
+    if (!_blocking && vusb->available(VUSBController::KeyboardInterface) < 5 * reportsPerKeystroke())
+        return false;
+
+    checkpoint();
+    return true;
+}
+
+void Keyboard_::checkpoint() {
+    releaseTyped();
+    _echoAwaited = vusb->ledChangeCount() + 2;
+    for (uint8_t tap = 0; tap < 2; tap++) {
+        typeKeystroke(0, KEY_SCROLL_LOCK - 136);
+        _checkHandle = releaseTyped();
+    }
+
+    _echoPending = true;
+    _checkArrived = false;
+    _checkTime = millis();
+    _sinceCheck = 0;
+}
+
+// Has the host answered the checkpoint yet? True while still waiting
+bool Keyboard_::awaitingEcho() {
+    if (!_echoPending)
+        return false;
+
+    uint32_t now = millis();
+    if (!_checkArrived && vusb->isDelivered(_checkHandle)) {
+        _checkArrived = true;
+        _checkTime = now;
+    }
+
+    if ((int8_t)(vusb->ledChangeCount() - _echoAwaited) >= 0) {
+        _echoPending = false;
+        adaptRate(_checkArrived ? now - _checkTime : 0);
+        return false;
+    }
+
+    // Never answered: stop verifying, and go back to the original rate.
+    // (Never even collected: the host has stopped polling, and the controller will give up on the queue)
+    if (now - _checkTime > (_checkArrived ? VERIFY_TIMEOUT : 5000UL)) {
+        setVerifiedTyping(0);
+        return false;
+    }
+
+    return true;
+}
+
+// Speed up gently, back off quickly
+void Keyboard_::adaptRate(uint32_t lag) {
+    if (lag <= VERIFY_FAST)
+        tx_delay = tx_delay * 3 / 4;
+    else if (lag >= VERIFY_SLOW)
+        tx_delay = min(tx_delay * 2 + 2, VERIFY_MAX_DELAY);
+}
+
+uint8_t Keyboard_::getLedStatus() {
+    return vusb->ledStatus();
+}
+
+void Keyboard_::onLedChange(void (*callback)(uint8_t leds)) {
+    vusb->onLedChange(callback);
+}
+
 void Keyboard_::setTxDelay(uint16_t delay) {
     this->tx_delay = delay;
 }
+
+// Each character needs at most two keystrokes (a release, then the press), plus one to release the last key.
+// With N-key rollover, a keystroke can take two reports.
+int Keyboard_::availableForWrite() {
+    uint8_t per_keystroke = reportsPerKeystroke();
+    uint8_t free = vusb->available(VUSBController::KeyboardInterface);
+    if (free < 3 * per_keystroke)
+        return 0;
+
+    return (free - per_keystroke) / (2 * per_keystroke);
+}
+
+void Keyboard_::setBlocking(bool blocking) {
+    this->_blocking = blocking;
+}
+
+// Switch between the standard report (up to 5 keys) and the N-key rollover bitmap.
+// Everything is released first, so no key is left stuck in the old report.
+void Keyboard_::setNKRO(bool enable) {
+    if (enable == _nkro)
+        return;
+
+    releaseTyped();
+    releaseAll();
+    _nkro = enable;
+}
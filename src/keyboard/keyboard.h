@@ -3,6 +3,7 @@
 
 #include <Arduino.h>
 #include "vusb/vusb_controller.h"
+#include "keyboard/hid_str.h"
 
 /*
   Keyboard.h
@@ -105,6 +106,13 @@
 #define KEY_F23           0xFA
 #define KEY_F24           0xFB
 
+// LEDs, as set by the host (getLedStatus)
+#define LED_NUM_LOCK      0x01
+#define LED_CAPS_LOCK     0x02
+#define LED_SCROLL_LOCK   0x04
+#define LED_COMPOSE       0x08
+#define LED_KANA          0x10
+
 // Supported keyboard layouts
 extern const uint8_t KeyboardLayout_de_DE[];
 extern const uint8_t KeyboardLayout_en_US[];
@@ -114,36 +122,139 @@ extern const uint8_t KeyboardLayout_it_IT[];
 extern const uint8_t KeyboardLayout_sv_SE[];
 extern const uint8_t KeyboardLayout_da_DK[];
 
-// Low level key report: up to 6 keys and shift, ctrl etc at once
+// Characters beyond ASCII, for some layouts: a key (encoded as in the layout), typed after a dead key if there is one.
+// Sorted by code point, and ended by {0, 0, 0}
+typedef struct {
+  uint16_t codepoint;
+  uint8_t key;
+  uint8_t dead;         // 0: none
+} UnicodeKey;
+
+extern const UnicodeKey KeyboardUnicode_de_DE[];
+extern const UnicodeKey KeyboardUnicode_sv_SE[];
+extern const UnicodeKey KeyboardUnicode_da_DK[];
+
+// Low level key report: up to 5 keys and shift, ctrl etc at once
 typedef struct {
-  uint8_t reportID = 2;
+  uint8_t reportID = USB_REPORT_ID_KEYBOARD;
   uint8_t modifiers;
+#if USB_BOOT_INTERFACES
+  uint8_t keys[6];      // The report ID is swapped for the reserved byte as the report goes out, so 6 keys fit
+#else
   uint8_t reserved;
   uint8_t keys[5];
+#endif
 } KeyReport;
 
+// Supplies text for Keyboard.typeFrom(): copy up to size characters, from offset characters into the text.
+// Return how many were copied. 0: end of the text
+typedef uint8_t (*TextReader)(void *context, size_t offset, uint8_t *buffer, uint8_t size);
+
+// Text which isn't in RAM (flash, EEPROM, typeFrom) is read this many characters at a time
+#define TYPE_WINDOW       16
+
+// N-key rollover: the bit for each usage 0x00 - 0x73, sent as report IDs 6, 7 and 8.
+// Report ID 6 also carries the modifiers.
+#define NKRO_REPORT_ID    6
+#define NKRO_SEGMENTS     3
+#define NKRO_LAST_USAGE   0x73
+
 class Keyboard_ : public Print {
 
 public:
   Keyboard_() = delete;
   Keyboard_(VUSBController *vusb);
-  void begin(const uint8_t *layout = KeyboardLayout_en_US);
+  void begin(const uint8_t *layout = KeyboardLayout_en_US, const UnicodeKey *unicode = nullptr);
   void end(void);
+  void setLayout(const uint8_t *layout, const UnicodeKey *unicode = nullptr);    // At once, without reconnecting
+  const uint8_t *getLayout();
   size_t write(uint8_t k);
-  size_t write(const uint8_t *buffer, size_t size);
-  size_t press(uint8_t k);
+  size_t write(const uint8_t *buffer, size_t size);     // UTF-8
+  size_t type(const HIDString &text);    // A string compiled by HID_STR (hid_str.h)
+  using Print::print;
+  using Print::println;
+  size_t print(const __FlashStringHelper *text);     // F("..."): streamed from flash, without a copy in RAM
+  size_t println(const __FlashStringHelper *text);
+  size_t typeFlash(const char *text);                 // PROGMEM string
+  size_t typeEEPROM(uint16_t address, size_t length); // Stops early at a '\0'
+  size_t typeFrom(TextReader reader, void *context);  // Any other source, e.g. an SD card
+
+  // Type under another layout, just this once (e.g. for a window whose layout differs)
+  size_t printIn(const uint8_t *layout, const char *text, const UnicodeKey *unicode = nullptr);
+  size_t printIn(const uint8_t *layout, const __FlashStringHelper *text, const UnicodeKey *unicode = nullptr);
+  int availableForWrite();       // Characters which can be typed without waiting
+  size_t press(uint8_t k);       // Returns a ReportHandle (see VUSB.isDelivered), or 0 on failure
   size_t release(uint8_t k);
   void releaseAll(void);
+  bool isPressed(uint8_t k);
+  uint8_t pressedCount();
 
   void setTxDelay(uint16_t delay);
+  void setBlocking(bool blocking);    // false: write() and print() type only what fits in the queue
+  void setNKRO(bool enable);          // true: any number of keys can be held at once
+
+  void setVerifiedTyping(uint8_t every);          // Check the host keeps up every n characters, and adapt the rate. 0: off
+
+  uint8_t getLedStatus();                         // LED_CAPS_LOCK etc.
+  void onLedChange(void (*callback)(uint8_t leds));   // Runs from the polling interrupt: keep it short
 
 private:
   KeyReport _keyReport;
   const uint8_t *_asciimap;
-  void sendReport(KeyReport* keys);
+  const UnicodeKey *_unicode = nullptr;
+  uint16_t _unicodeCount = 0;
+  ReportHandle sendReport(KeyReport* keys);
+
+  bool toKeystroke(uint8_t k, uint8_t *modifiers, uint8_t *usage);
+  static void decodeKey(uint8_t key, uint8_t *modifiers, uint8_t *usage);
+  bool findUnicode(uint16_t c, uint8_t *key, uint8_t *dead);
+  bool addKey(KeyReport *report, uint8_t k);
+
+  // Held keys: one bit per usage, plus _keyReport.modifiers
+  uint8_t _keys[16] = {0};
+  uint8_t _pressedCount = 0;
+  bool isHeld(uint8_t usage);
+  void holdKey(uint8_t modifiers, uint8_t usage);
+  void letGoKey(uint8_t modifiers, uint8_t usage);
+
+  // Streaming typing engine, used by write() and type()
+  size_t typeChars(const uint8_t *buffer, size_t size);
+  static uint8_t readFlash(void *context, size_t offset, uint8_t *buffer, uint8_t size);
+  static uint8_t readEEPROM(void *context, size_t offset, uint8_t *buffer, uint8_t size);
+  bool typeCharacter(uint16_t c);
+  bool typeNext(uint8_t modifiers, uint8_t usage, bool letter, uint8_t deadModifiers = 0, uint8_t deadUsage = 0);
+  bool typeKeystroke(uint8_t modifiers, uint8_t usage);
+  ReportHandle releaseTyped();
+  uint8_t _typedUsage = 0;        // Key currently held down by the engine
+  uint8_t _typedModifiers = 0;
+  bool needsRelease(uint8_t modifiers, uint8_t usage);
+  void followCapsLock(bool letter, uint8_t *modifiers);
+  static bool isLetter(uint16_t c);
+
+  // Verified typing: every few characters, tap Scroll Lock twice, and time the host's LED reports
+  uint8_t _verifyEvery = 0;
+  uint8_t _sinceCheck = 0;
+  bool _echoPending = false;
+  bool _checkArrived = false;
+  uint8_t _echoAwaited;           // ledChangeCount() once the host has answered
+  ReportHandle _checkHandle;      // Final Scroll Lock report of the checkpoint
+  uint32_t _checkTime;            // When the checkpoint was queued, then when it reached the host
+  uint16_t _baseDelay;            // tx_delay before verified typing started adjusting it
+  bool verify();
+  bool awaitingEcho();
+  void checkpoint();
+  void adaptRate(uint32_t lag);
+  bool _blocking = true;
+
+  // N-key rollover
+  bool _nkro = false;
+  ReportHandle sendNKRO(uint8_t segments);
+  uint8_t nkroSegments(uint8_t modifiers, uint8_t usage);
+  bool useNKRO();
+  uint8_t reportsPerKeystroke();
 
   VUSBController *vusb;
-  uint16_t tx_delay = 20;
+  uint16_t tx_delay;        // Set in the constructor, which sees the library's own USB_COUNT_SOF
 };
 
 
@@ -1,4 +1,60 @@
 #include "mouse/mouse.h"
+#include "util/atomic.h"
+
+// Add the motion of a new report onto one which is still waiting to be sent.
+// Values saturate at +-32767. Anything past that is carried over, and sent in a later report.
+static int16_t addSaturated(int16_t queued, int16_t *incoming) {
+    int32_t sum = (int32_t) queued + *incoming;
+    int32_t clamped = constrain(sum, -32767, 32767);
+    *incoming = sum - clamped;
+    return clamped;
+}
+
+// Both relative reports are a report ID and a byte, followed by a pair of 16 bit values: (X, Y), or (wheel, pan)
+static bool mergePair(uint8_t *queued, uint8_t *incoming) {
+    int16_t a = queued[2] | (queued[3] << 8);
+    int16_t b = queued[4] | (queued[5] << 8);
+
+    int16_t carry_a = incoming[2] | (incoming[3] << 8);
+    int16_t carry_b = incoming[4] | (incoming[5] << 8);
+
+    a = addSaturated(a, &carry_a);
+    b = addSaturated(b, &carry_b);
+
+    queued[2] = a & 0xFF;
+    queued[3] = a >> 8;
+    queued[4] = b & 0xFF;
+    queued[5] = b >> 8;
+
+    incoming[2] = carry_a & 0xFF;
+    incoming[3] = carry_a >> 8;
+    incoming[4] = carry_b & 0xFF;
+    incoming[5] = carry_b >> 8;
+
+    // Send the remainder separately, if anything overflowed
+    return (carry_a == 0 && carry_b == 0);
+}
+
+static bool mergeMotion(uint8_t *queued, uint8_t *incoming) {
+    // Only motion is combined. Button changes must reach the host in their own report
+    if (queued[0] != incoming[0] || queued[1] != incoming[1])
+        return false;
+
+    // Don't move the cursor before a queued click has happened
+    if (!(queued[2] | queued[3] | queued[4] | queued[5]))
+        return false;
+
+    return mergePair(queued, incoming);
+}
+
+// Report ID 4: [4, 0, wheel, pan]. Byte 1 is padding, so the layout matches the motion report
+static bool mergeScroll(uint8_t *queued, uint8_t *incoming) {
+    if (queued[0] != incoming[0])
+        return false;
+
+    return mergePair(queued, incoming);
+}
+
 
 // Grab reference to the controller, so we can call VUSBController::mouseOn(), etc
 MouseDevice::MouseDevice( VUSBController *vusb ) {
@@ -9,10 +65,16 @@ MouseDevice::MouseDevice( VUSBController *vusb ) {
 void MouseDevice::begin() {
     // Let the controller decide whether vusb should init
     vusb_controller->mouseOn();
+
+    // Glides are generated one report at a time, as the endpoint becomes free
+    vusb_controller->setReportSource(VUSBController::MouseInterface, glideStep, this);
 }
 
 
 void MouseDevice::end() {
+    gliding = false;
+    vusb_controller->setReportSource(VUSBController::MouseInterface, nullptr, nullptr);
+
     // Disconnect USB, if keyboard isn't also enabled
     vusb_controller->mouseOff();
 }
@@ -36,27 +98,13 @@ void MouseDevice::setButton(MouseButton button, bool state) {
     report[3] = 0;
     report[4] = 0;
     report[5] = 0;
-    report[6] = 0;
 }
 
 
 // Send the report (Tell host what our mouse is doing)
-void MouseDevice::update() {
-    vusb_controller->pausePolling();    // No auto-polling with timer
-
-    // See if we are ready to use USB
-    for ( uint16_t i = 0; i < 5000; i += 15 ) {
-        usbPoll();
-        if (usbInterruptIsReady()) {
-            // Send the report
-            usbSetInterrupt(report, sizeof(report));
-            break;
-        }
-        delay(15);
-    }
-    
-    delay(tx_delay);
-    vusb_controller->resumePolling();
+ReportHandle MouseDevice::update() {
+    // Snapshot the report; the controller sends it in the background
+    return vusb_controller->queueReport(VUSBController::MouseInterface, report, sizeof(report), tx_delay);
 }
 
 
@@ -75,26 +123,49 @@ void MouseDevice::click( MouseButton button ) {
 }
 
 
-void MouseDevice::move(int16_t x, int16_t y, int8_t wheel) {
-    report[2] = x & 0xFF;
-    report[3] = x >> 8;
-    report[4] = y & 0xFF;
-    report[5] = y >> 8;
-    report[6] = wheel;
+// If the previous report hasn't been collected yet, the movement is added to it, rather than waiting.
+// In that case, the handle returned is the one for the combined report
+ReportHandle MouseDevice::move(int16_t x, int16_t y, int8_t wheel) {
+    ReportHandle handle = 0;
 
-    update();
+    if (x || y || !wheel) {
+        report[2] = x & 0xFF;
+        report[3] = x >> 8;
+        report[4] = y & 0xFF;
+        report[5] = y >> 8;
+
+        handle = vusb_controller->queueReport(VUSBController::MouseInterface, report, sizeof(report), tx_delay, mergeMotion);
+    }
+
+    // Wheel has its own report
+    if (wheel)
+        handle = scroll(wheel);
+
+    return handle;
 }
 
 
-void MouseDevice::press(MouseButton button) {
+// Place the cursor at an exact point, regardless of pointer acceleration: (0, 0) is top left, (32767, 32767) bottom right.
+// Sent as Report ID 3, which has no buttons: a padding byte where the relative report has them. Hosts which merge
+// both reports into one device would otherwise see buttons held by press() let go whenever the cursor is placed.
+ReportHandle MouseDevice::moveTo(uint16_t x, uint16_t y) {
+    x = min(x, 32767);
+    y = min(y, 32767);
+
+    uint8_t absolute[6] = {USB_REPORT_ID_POINTER, 0, (uint8_t) (x & 0xFF), (uint8_t) (x >> 8), (uint8_t) (y & 0xFF), (uint8_t) (y >> 8)};
+    return vusb_controller->queueReport(VUSBController::MouseInterface, absolute, sizeof(absolute), tx_delay);
+}
+
+
+ReportHandle MouseDevice::press(MouseButton button) {
     setButton(button, true);
-    update();
+    return update();
 }
 
 
-void MouseDevice::release(MouseButton button) {
+ReportHandle MouseDevice::release(MouseButton button) {
     setButton(button, false);
-    update();
+    return update();
 }
 
 
@@ -114,27 +185,164 @@ void MouseDevice::longClick(uint16_t duration, MouseButton button) {
 }
 
 
-// Scroll using the mouse wheel
-void MouseDevice::scroll(int16_t amount) {
-    uint8_t sign = (amount > 0) ? 1 : -1; 
-    amount = abs(amount);
+// Wheel units per click, once the host has set the Resolution Multiplier (Feature Report ID 5)
+#define WHEEL_HIGH_RESOLUTION 120
+#define MULTIPLIER_WHEEL 0x01
+#define MULTIPLIER_PAN 0x04
 
-    // Clear any old movement from the report
-    report[2] = 0;
-    report[3] = 0;
-    report[4] = 0;
-    report[5] = 0;
-    report[6] = 0;
-
-    //Scroll piece by piece until value is met
-    while (amount > 0) {
-        report[6] = min(127, amount);
-        amount -= report[6];
-        report[6] *= sign;
-        update();
+
+// Scroll using the mouse wheel. Positive is up. Usually fits in a single report
+ReportHandle MouseDevice::scroll(int16_t amount) {
+    int32_t wheel = amount;
+    if (vusb_controller->resolutionMultiplier() & MULTIPLIER_WHEEL)
+        wheel *= WHEEL_HIGH_RESOLUTION;
+
+    return sendScroll(wheel, 0);
+}
+
+
+// Scroll sideways (AC Pan). Positive is right
+ReportHandle MouseDevice::pan(int16_t amount) {
+    int32_t pan = amount;
+    if (vusb_controller->resolutionMultiplier() & MULTIPLIER_PAN)
+        pan *= WHEEL_HIGH_RESOLUTION;
+
+    return sendScroll(0, pan);
+}
+
+
+// Smooth scrolling, in 1/120 of a click. 
+// If the host hasn't enabled high resolution, part-clicks are saved up, and sent once they make a whole click
+ReportHandle MouseDevice::scrollFine(int16_t amount) {
+    return sendFine(amount, &fine_wheel, MULTIPLIER_WHEEL, true);
+}
+
+
+ReportHandle MouseDevice::panFine(int16_t amount) {
+    return sendFine(amount, &fine_pan, MULTIPLIER_PAN, false);
+}
+
+
+bool MouseDevice::isHighResolution() {
+    return vusb_controller->resolutionMultiplier() & MULTIPLIER_WHEEL;
+}
+
+
+ReportHandle MouseDevice::sendFine(int16_t amount, int16_t *remainder, uint8_t multiplier_bit, bool vertical) {
+    int32_t value = amount;
+
+    if (!(vusb_controller->resolutionMultiplier() & multiplier_bit)) {
+        value += *remainder;
+        *remainder = value % WHEEL_HIGH_RESOLUTION;
+        value /= WHEEL_HIGH_RESOLUTION;
+
+        if (value == 0)
+            return 0;
     }
 
-    //Clear the scroll wheel, relative value needs to return to 0
-    report[6] = 0;
-    update();
-}
\ No newline at end of file
+    if (vertical)
+        return sendScroll(value, 0);
+    else
+        return sendScroll(0, value);
+}
+
+
+// Report ID 4: [4, 0, wheel, pan]. Anything beyond 16 bits goes in further reports
+ReportHandle MouseDevice::sendScroll(int32_t wheel, int32_t pan) {
+    ReportHandle handle = 0;
+
+    do {
+        int16_t w = constrain(wheel, -32767, 32767);
+        int16_t p = constrain(pan, -32767, 32767);
+        wheel -= w;
+        pan -= p;
+
+        uint8_t scroll[6] = {0x04, 0, (uint8_t) (w & 0xFF), (uint8_t) (w >> 8), (uint8_t) (p & 0xFF), (uint8_t) (p >> 8)};
+        handle = vusb_controller->queueReport(VUSBController::MouseInterface, scroll, sizeof(scroll), tx_delay, mergeScroll);
+    } while ((wheel || pan) && handle);
+
+    return handle;
+}
+
+
+// Move smoothly by (x, y) over duration (ms). Returns immediately: the motion is sent from the polling interrupt,
+// one report each time the host collects the last one. Any glide already in progress is abandoned.
+void MouseDevice::glide(int16_t x, int16_t y, uint16_t duration, GlideCurve curve) {
+    // The interrupt leaves the glide alone until it is switched back on, so only the switch needs interrupts masked
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        gliding = false;
+    }
+
+    glide_x = constrain(x, -32767, 32767);
+    glide_y = constrain(y, -32767, 32767);
+    glided_x = 0;
+    glided_y = 0;
+    glide_start = millis();
+    glide_duration = duration;
+    glide_curve = curve;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        gliding = true;
+    }
+}
+
+
+bool MouseDevice::isGliding() {
+    return gliding;
+}
+
+
+bool MouseDevice::glideStep(void *context, uint8_t *report, uint8_t *length) {
+    return ((MouseDevice*) context)->nextGlideReport(report, length);
+}
+
+
+// Called from the polling interrupt. Works out where the cursor should be by now, and sends the difference.
+// Positions are rounded to whole counts; the fraction carries into the next report, so nothing is lost
+bool MouseDevice::nextGlideReport(uint8_t *report, uint8_t *length) {
+    if (!gliding)
+        return false;
+
+    uint32_t elapsed = millis() - glide_start;
+    uint16_t progress = (elapsed >= glide_duration) ? 256 : (elapsed << 8) / glide_duration;    // Q8.8, 0 to 1
+    uint16_t eased = ease(progress, glide_curve);
+
+    int16_t x = ((int32_t) glide_x * eased + 128) >> 8;
+    int16_t y = ((int32_t) glide_y * eased + 128) >> 8;
+    int16_t step_x = x - glided_x;
+    int16_t step_y = y - glided_y;
+    glided_x = x;
+    glided_y = y;
+
+    if (progress == 256)
+        gliding = false;
+
+    // Nothing to send this time
+    if (step_x == 0 && step_y == 0)
+        return false;
+
+    memcpy(report, this->report, sizeof(this->report));     // Report ID, buttons
+    report[2] = step_x & 0xFF;
+    report[3] = step_x >> 8;
+    report[4] = step_y & 0xFF;
+    report[5] = step_y >> 8;
+    *length = sizeof(this->report);
+    return true;
+}
+
+
+// Shape of the glide. Progress in, position out: both Q8.8, 0 (start) to 256 (end)
+uint16_t MouseDevice::ease(uint16_t progress, GlideCurve curve) {
+    uint32_t p = progress;
+    switch (curve) {
+        case GLIDE_EASE_IN:
+            return (p * p) >> 8;
+        case GLIDE_EASE_OUT:
+            return 256 - (((256 - p) * (256 - p)) >> 8);
+        case GLIDE_EASE_IN_OUT:
+            return (p * p * (768 - 2 * p)) >> 16;       // Smoothstep: 3p^2 - 2p^3
+        case GLIDE_LINEAR:
+        default:
+            return p;
+    }
+}
@@ -6,6 +6,7 @@
 #include "vusb/driver/usbdrv.h"
 
 enum MouseButton : uint8_t {MOUSE_LEFT = 1, MOUSE_RIGHT = 2, MOUSE_MIDDLE = 3};
+enum GlideCurve : uint8_t {GLIDE_LINEAR, GLIDE_EASE_IN, GLIDE_EASE_OUT, GLIDE_EASE_IN_OUT};
 
 class MouseDevice {
     //Methods
@@ -15,9 +16,11 @@ class MouseDevice {
         void begin();
         void end();
 
-        void move(int16_t x, int16_t y, int8_t wheel = 0);
-        void press(MouseButton button = MOUSE_LEFT);
-        void release(MouseButton button = MOUSE_LEFT);
+        // Return a handle for the report (see VUSB.isDelivered), or 0 on failure
+        ReportHandle move(int16_t x, int16_t y, int8_t wheel = 0);
+        ReportHandle press(MouseButton button = MOUSE_LEFT);
+        ReportHandle release(MouseButton button = MOUSE_LEFT);
+        ReportHandle moveTo(uint16_t x, uint16_t y);                // Absolute position. 0 - 32767 spans the screen
         void click(MouseButton button = MOUSE_LEFT);
         
         bool isPressed(MouseButton button = MOUSE_LEFT);
@@ -26,20 +29,46 @@ class MouseDevice {
 
         void doubleClick(MouseButton button = MOUSE_LEFT);
         void longClick(uint16_t duration, MouseButton button = MOUSE_LEFT);
-        void scroll(int16_t amount);
+        ReportHandle scroll(int16_t amount);                        // Vertical wheel
+        ReportHandle pan(int16_t amount);                           // Horizontal wheel
+        ReportHandle scrollFine(int16_t amount);                    // 1/120 of a wheel click, if the host allows
+        ReportHandle panFine(int16_t amount);
+        bool isHighResolution();                                    // Host has enabled fine scrolling
+
+        void glide(int16_t x, int16_t y, uint16_t duration, GlideCurve curve = GLIDE_EASE_IN_OUT);    // Smooth move, in the background
+        bool isGliding();
 
         void setTxDelay(uint16_t delay);
-        void update();                                              // Send Mouse HID report
+        ReportHandle update();                                      // Send Mouse HID report
 
     private:
 
         void setButton(MouseButton button, bool state);             // Configure byte 1 of report
 
+        static bool glideStep(void *context, uint8_t *report, uint8_t *length);    // ReportSource, called by VUSBController
+        bool nextGlideReport(uint8_t *report, uint8_t *length);
+        static uint16_t ease(uint16_t progress, GlideCurve curve);
+
+        ReportHandle sendScroll(int32_t wheel, int32_t pan);        // Report ID 4, split if too large
+        ReportHandle sendFine(int16_t amount, int16_t *remainder, uint8_t multiplier_bit, bool vertical);
+
         VUSBController *vusb_controller;
 
     private:
         uint16_t tx_delay = 0;
-        uint8_t report[7] = {0x01, 0, 0, 0, 0, 0, 0};  //Bit 0 is ReportID 1, to show that we're sending mouse data
+        uint8_t report[6] = {0x01, 0, 0, 0, 0, 0};  //Bit 0 is ReportID 1, to show that we're sending mouse data
+
+        // Fine scrolling, without a high resolution host: part-clicks wait here until they add up
+        int16_t fine_wheel = 0;
+        int16_t fine_pan = 0;
+
+        // Glide: fixed point (Q8.8) progress along the curve
+        volatile bool gliding = false;
+        int16_t glide_x, glide_y;           // Total motion requested
+        int16_t glided_x, glided_y;         // Motion sent so far
+        uint32_t glide_start;
+        uint16_t glide_duration;
+        GlideCurve glide_curve;
 } ;
 
 #endif //__MOUSE_H__
\ No newline at end of file
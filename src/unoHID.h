@@ -5,7 +5,7 @@
 
 // V-USB 
 #include "vusb/usb_descriptor.h"        // Define the USB device
-#include "vusb/usbFunctionSetup.h"      // Define a required extern function of vusb, which we don't actually use
+#include "vusb/usbFunctionSetup.h"      // Answer HID class requests from the host (feature reports)
 #include "vusb/vusb_controller.h"       // Background class - communication between Mouse and Keyboard
 
 
@@ -9,11 +9,23 @@
 /* This is the port where the USB bus is connected. When you configure it to
  * "B", the registers PORTB, PINB and DDRB will be used.
  */
+#ifndef USB_COUNT_SOF
+#define USB_COUNT_SOF           0
+#endif
+/* unoHID: Start-of-frame pacing (see USB_COUNT_SOF below). Set to 1 to pace
+ * reports in USB frames instead of milliseconds. The SOF marker is only seen
+ * on D-, so D- and D+ must be swapped: D- to pin 2 (INT0), D+ to pin 4.
+ */
+#if USB_COUNT_SOF
+#define USB_CFG_DMINUS_BIT      2
+#define USB_CFG_DPLUS_BIT       4
+#else
 #define USB_CFG_DMINUS_BIT      4
 /* This is the bit number in USB_CFG_IOPORT where the USB D- line is connected.
  * This may be any bit in the port.
  */
 #define USB_CFG_DPLUS_BIT       2
+#endif
 /* This is the bit number in USB_CFG_IOPORT where the USB D+ line is connected.
  * This may be any bit in the port. Please note that D+ must also be connected
  * to interrupt pin INT0! [You can also use other interrupts, see section
@@ -57,7 +69,7 @@
  * default control endpoint 0 and an interrupt-in endpoint (any other endpoint
  * number).
  */
-#define USB_CFG_HAVE_INTRIN_ENDPOINT3   0
+#define USB_CFG_HAVE_INTRIN_ENDPOINT3   1     /* unoHID: mouse has its own endpoint */
 /* Define this to 1 if you want to compile a version with three endpoints: The
  * default control endpoint 0, an interrupt-in endpoint 3 (or the number
  * configured below) and a catch-all default interrupt-in endpoint as above.
@@ -101,7 +113,7 @@
  * The value is in milliamperes. [It will be divided by two since USB
  * communicates power requirements in units of 2 mA.]
  */
-#define USB_CFG_IMPLEMENT_FN_WRITE      0
+#define USB_CFG_IMPLEMENT_FN_WRITE      1     /* unoHID: SET_REPORT, see usbFunctionSetup.h */
 /* Set this to 1 if you want usbFunctionWrite() to be called for control-out
  * transfers. Set it to 0 if you don't need it and want to save a couple of
  * bytes.
@@ -135,7 +147,13 @@
  * proceed, do a return after doing your things. One possible application
  * (besides debugging) is to flash a status LED on each packet.
  */
-/* #define USB_RESET_HOOK(resetStarts)     if(!resetStarts){hadUsbReset();} */
+#ifndef __ASSEMBLER__
+#ifdef __cplusplus
+extern "C"
+#endif
+void usbBusReset(void);     /* unoHID: see usbFunctionSetup.h */
+#endif
+#define USB_RESET_HOOK(resetStarts)     if(!resetStarts){usbBusReset();}
 /* This macro is a hook if you need to know when an USB RESET occurs. It has
  * one parameter which distinguishes between the start of RESET state and its
  * end.
@@ -144,8 +162,9 @@
 /* This macro (if defined) is executed when a USB SET_ADDRESS request was
  * received.
  */
-#define USB_COUNT_SOF                   0
-/* define this macro to 1 if you need the global variable "usbSofCount" which
+/* #define USB_COUNT_SOF                   0 */
+/* unoHID: defined near the top of this file, since it changes the wiring.
+ * define this macro to 1 if you need the global variable "usbSofCount" which
  * counts SOF packets. This feature requires that the hardware interrupt is
  * connected to D- instead of D+.
  */
@@ -253,7 +272,7 @@
  * HID class is 3, no subclass and protocol required (but may be useful!)
  * CDC class is 2, use subclass 2 and protocol 1 for ACM
  */
-#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH 111
+#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH 0     /* unoHID: one report descriptor per interface, see usb_descriptor.h */
 /* Define this to the length of the HID report descriptor, if you implement
  * an HID device. Otherwise don't define it or define it to 0.
  * If you use this define, you must add a PROGMEM character array named
@@ -319,14 +338,14 @@
  */
 
 #define USB_CFG_DESCR_PROPS_DEVICE                  0
-#define USB_CFG_DESCR_PROPS_CONFIGURATION           0
+#define USB_CFG_DESCR_PROPS_CONFIGURATION           USB_PROP_LENGTH(59)     /* unoHID: keyboard and mouse interfaces, usb_descriptor.h */
 #define USB_CFG_DESCR_PROPS_STRINGS                 0
 #define USB_CFG_DESCR_PROPS_STRING_0                0
 #define USB_CFG_DESCR_PROPS_STRING_VENDOR           0
 #define USB_CFG_DESCR_PROPS_STRING_PRODUCT          0
 #define USB_CFG_DESCR_PROPS_STRING_SERIAL_NUMBER    0
-#define USB_CFG_DESCR_PROPS_HID                     0
-#define USB_CFG_DESCR_PROPS_HID_REPORT              0
+#define USB_CFG_DESCR_PROPS_HID                     USB_PROP_IS_DYNAMIC     /* unoHID: depends on interface, usbFunctionDescriptor() */
+#define USB_CFG_DESCR_PROPS_HID_REPORT              USB_PROP_IS_DYNAMIC
 #define USB_CFG_DESCR_PROPS_UNKNOWN                 0
 
 
@@ -246,7 +246,13 @@ USB_PUBLIC void usbSetInterrupt(uchar *data, uchar len);
  * message already buffered will be lost.
  */
 #if USB_CFG_HAVE_INTRIN_ENDPOINT3
+#ifdef __cplusplus
+extern "C"{
+#endif
 USB_PUBLIC void usbSetInterrupt3(uchar *data, uchar len);
+#ifdef __cplusplus
+} // extern "C"
+#endif
 #define usbInterruptIsReady3()   (usbTxLen3 & 0x10)
 /* Same as above for endpoint 3 */
 #endif
@@ -262,7 +268,13 @@ USB_PUBLIC void usbSetInterrupt3(uchar *data, uchar len);
  */
 #endif  /* USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH */
 #if USB_CFG_IMPLEMENT_FN_WRITE
+#ifdef __cplusplus
+extern "C"{
+#endif
 USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len);
+#ifdef __cplusplus
+} // extern "C"
+#endif
 /* This function is called by the driver to provide a control transfer's
  * payload data (control-out). It is called in chunks of up to 8 bytes. The
  * total count provided in the current control transfer can be obtained from
@@ -0,0 +1,72 @@
+#include "report_queue.h"
+
+// Copy a report into the back of the queue. Returns false if there is no room
+bool ReportQueue::push(const uint8_t *report, uint8_t length, uint16_t hold, uint16_t handle, uint16_t queued_at) {
+    if (isFull() || length > REPORT_MAX_LENGTH)
+        return false;
+
+    QueuedReport *tail = &slots[slot(count)];
+    tail->length = length;
+    tail->hold = hold;
+    tail->handle = handle;
+    tail->queued_at = queued_at;
+    memcpy(tail->data, report, length);
+
+    count++;
+    return true;
+}
+
+// Oldest report, or nullptr if empty
+QueuedReport* ReportQueue::front() {
+    return at(0);
+}
+
+// Newest report, or nullptr if empty. Still waiting, so it may be modified
+QueuedReport* ReportQueue::back() {
+    if (isEmpty())
+        return nullptr;
+
+    return at(count - 1);
+}
+
+// Any waiting report, oldest first. Nullptr past the end
+QueuedReport* ReportQueue::at(uint8_t index) {
+    if (index >= count)
+        return nullptr;
+
+    return &slots[slot(index)];
+}
+
+// Discard the oldest report, once it has been handed to the driver
+void ReportQueue::pop() {
+    if (isEmpty())
+        return;
+
+    head++;
+    if (head >= REPORT_QUEUE_LENGTH)
+        head = 0;
+    count--;
+}
+
+// Discard a report from anywhere in the queue. Those behind it move up, so the order is kept
+void ReportQueue::remove(uint8_t index) {
+    if (index >= count)
+        return;
+
+    for (uint8_t i = index; i + 1 < count; i++)
+        slots[slot(i)] = slots[slot(i + 1)];
+    count--;
+}
+
+void ReportQueue::clear() {
+    head = 0;
+    count = 0;
+}
+
+uint8_t ReportQueue::slot(uint8_t index) {
+    uint8_t position = head + index;
+    if (position >= REPORT_QUEUE_LENGTH)
+        position -= REPORT_QUEUE_LENGTH;
+
+    return position;
+}
@@ -0,0 +1,47 @@
+#ifndef __REPORT_QUEUE_H__
+#define __REPORT_QUEUE_H__
+
+#include <Arduino.h>
+
+// How many HID reports may wait to be sent. Each slot costs 16 bytes of SRAM, per endpoint
+#ifndef REPORT_QUEUE_LENGTH
+    #define REPORT_QUEUE_LENGTH 8
+#endif
+
+// Largest report which fits in a single low-speed interrupt packet
+#define REPORT_MAX_LENGTH 8
+
+// A snapshot of a report, waiting for the endpoint to become free
+struct QueuedReport {
+    uint8_t length;
+    uint16_t hold;                      // Minimum time (ms) before the next report may follow
+    uint16_t handle;                    // Identifies the report, once it reaches the host (ReportHandle)
+    uint16_t queued_at;                 // millis() when queued, low 16 bits. For the deadline
+    uint8_t data[REPORT_MAX_LENGTH];
+};
+
+// Fixed-size ring buffer. Not safe on its own: VUSBController keeps poll() away while the sketch changes it
+class ReportQueue {
+    public:
+        bool push(const uint8_t *report, uint8_t length, uint16_t hold, uint16_t handle, uint16_t queued_at);
+        QueuedReport* front();
+        QueuedReport* back();
+        QueuedReport* at(uint8_t index);    // 0: oldest
+        void pop();
+        void remove(uint8_t index);
+        void clear();
+
+        bool isEmpty()  { return count == 0; }
+        bool isFull()   { return count == REPORT_QUEUE_LENGTH; }
+        uint8_t available() { return REPORT_QUEUE_LENGTH - count; }
+        uint8_t size()      { return count; }
+
+    private:
+        uint8_t slot(uint8_t index);        // Where the report at index is kept
+
+        QueuedReport slots[REPORT_QUEUE_LENGTH];
+        volatile uint8_t head = 0;      // Oldest report
+        volatile uint8_t count = 0;
+} ;
+
+#endif
@@ -5,9 +5,10 @@
 
 #ifdef POLL_WITH_TIMER1
 
-    ISR(TIMER1_COMPA_vect){
-        VUSB.poll();   //Every 8ms - 125Hz
+    // Every 8ms (125Hz), or every 1ms with start-of-frame pacing.
+    // Let the USB interrupt in, rather than making it wait behind us: VUSB.poll() guards against running twice
+    ISR(TIMER1_COMPA_vect, ISR_NOBLOCK){
+        VUSB.poll();
     }
 
 #endif
-
@@ -5,7 +5,8 @@
 
 // volatile uint16_t __POLLING_WITH_TIMER_2_COUNTER__ = 0;
 
-// Timer set for 100Hz - 10ms
-ISR(TIMER2_COMPA_vect){
+// Every 10ms (100Hz), or every 1ms with start-of-frame pacing.
+// Let the USB interrupt in, rather than making it wait behind us: VUSB.poll() guards against running twice
+ISR(TIMER2_COMPA_vect, ISR_NOBLOCK){
     VUSB.poll();
-}
\ No newline at end of file
+}
@@ -1,4 +1,10 @@
-// We're really not using this in our implementation, but it still needs to be defined somewhere
+// V-USB hands HID class requests (GET_REPORT, SET_REPORT, ...) and bus resets to these. The controller deals with them
 
 #include <vusb/driver/usbdrv.h>
-USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]) {return 0;}
\ No newline at end of file
+#include "vusb/vusb_controller.h"
+
+extern VUSBController VUSB;
+
+USB_PUBLIC usbMsgLen_t usbFunctionSetup(uchar data[8]) {return VUSB.functionSetup(data);}
+USB_PUBLIC uchar usbFunctionWrite(uchar *data, uchar len) {return VUSB.functionWrite(data, len);}
+USB_PUBLIC void usbBusReset(void) {VUSB.busReset();}
\ No newline at end of file
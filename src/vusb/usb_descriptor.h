@@ -14,12 +14,43 @@
 #define USB_CFG_DEVICE_NAME         'U', 'n', 'o', 'H', 'I', 'D'
 
 
+// Interfaces
+// ------------------
+
+// Keyboard and mouse are separate HID interfaces, each with its own interrupt endpoint,
+// so mouse movement never has to wait for the keyboard's queue (or vice versa)
+
+#define USB_INTERFACE_KEYBOARD      0       // Endpoint 1
+#define USB_INTERFACE_MOUSE         1       // Endpoint 3
+
+// Boot interfaces
+// ------------------
+
+// 1: declare keyboard and mouse as boot devices (subclass 1, protocols 1 and 2), so BIOS, UEFI and KVM switches
+// recognise them without reading the report descriptors. The keyboard then sends the standard 8 byte boot report,
+// with no report ID, so it has room for 6 keys, but no N-key rollover. Must match in every file: set it here, or as a build flag.
+#ifndef USB_BOOT_INTERFACES
+#define USB_BOOT_INTERFACES         0
+#endif
+
+// Reports which have a boot protocol equivalent (BIOS, UEFI). The controller converts them when the host asks for boot protocol
+#define USB_REPORT_ID_MOUSE         1
+#define USB_REPORT_ID_KEYBOARD      2
+
+// Absolute pointer (Mouse.moveTo). Relative motion, or someone moving a real mouse, moves the cursor away without
+// the device knowing: the controller never skips this report as a duplicate, and never repeats it
+#define USB_REPORT_ID_POINTER       3
+
+
+// The descriptors themselves are only compiled into V-USB (usbdrv.c), which is C.
+// The sketch only needs the defines above.
+#ifndef __cplusplus
+
 // This describes (to the target device) the format 
 // which the Arduino will use to send mouse and keyboard data
 // ----------------------------------------------------------
 
-PROGMEM const uint8_t usbHidReportDescriptor[] =  { 
-    // Mouse Report
+PROGMEM const uint8_t usbHidReportDescriptorMouse[] =  { 
     0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
     0x09, 0x02,                    // USAGE (Mouse)
     0xa1, 0x01,                    // COLLECTION (Application)
@@ -45,16 +76,126 @@ PROGMEM const uint8_t usbHidReportDescriptor[] =  {
     0x81, 0x06,                    //           INPUT (Data,Var,Rel) 
     0x09, 0x31,                    //     USAGE (Y)
     0x81, 0x06,                    //     INPUT (Data,Var,Rel) 
+    0xC0,                          //       END_COLLECTION
+
+    // Scrolling: a separate report, so X, Y, wheel and pan don't have to squeeze into one 8 byte packet.
+    // Each axis sits in a logical collection with its own Resolution Multiplier (Feature, Report ID 5).
+    // If the host sets the multiplier, it expects wheel and pan in 1/120 of a detent
+    0xA1, 0x02,                    //   COLLECTION (Logical)   -   Wheel
+    0x85, 0x05,                    //     Report ID 5
+    0x09, 0x48,                    //     USAGE (Resolution Multiplier)
+    0x15, 0x00,                    //         LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //         LOGICAL_MAXIMUM (1)
+    0x35, 0x01,                    //         PHYSICAL_MINIMUM (1)
+    0x45, 0x78,                    //         PHYSICAL_MAXIMUM (120)
+    0x75, 0x02,                    //         REPORT_SIZE (2)
+    0x95, 0x01,                    //         REPORT_COUNT (1)
+    0xB1, 0x02,                    //         FEATURE (Data,Var,Abs)
+    0x35, 0x00,                    //         PHYSICAL_MINIMUM (0)
+    0x45, 0x00,                    //         PHYSICAL_MAXIMUM (0)
+    0x85, 0x04,                    //     Report ID 4
+    0x75, 0x08,                    //         REPORT_SIZE (8)     -   Pad a byte, to line up with Report ID 1
+    0x81, 0x03,                    //         INPUT (Const,Var,Abs)
     0x09, 0x38,                    //     USAGE (Wheel)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7F,                    //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
+    0x16, 0x01, 0x80,              //         LOGICAL_MINIMUM (-32767)
+    0x26, 0xFF, 0x7F,              //         LOGICAL_MAXIMUM (32767)
+    0x75, 0x10,                    //         REPORT_SIZE (16)
+    0x81, 0x06,                    //         INPUT (Data,Var,Rel)
+    0xC0,                          //   END_COLLECTION
+
+    0xA1, 0x02,                    //   COLLECTION (Logical)   -   Pan
+    0x85, 0x05,                    //     Report ID 5
+    0x09, 0x48,                    //     USAGE (Resolution Multiplier)
+    0x15, 0x00,                    //         LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //         LOGICAL_MAXIMUM (1)
+    0x35, 0x01,                    //         PHYSICAL_MINIMUM (1)
+    0x45, 0x78,                    //         PHYSICAL_MAXIMUM (120)
+    0x75, 0x02,                    //         REPORT_SIZE (2)
+    0xB1, 0x02,                    //         FEATURE (Data,Var,Abs)
+    0x35, 0x00,                    //         PHYSICAL_MINIMUM (0)
+    0x45, 0x00,                    //         PHYSICAL_MAXIMUM (0)
+    0x85, 0x04,                    //     Report ID 4
+    0x05, 0x0C,                    //     USAGE_PAGE (Consumer)
+    0x0A, 0x38, 0x02,              //     USAGE (AC Pan)
+    0x16, 0x01, 0x80,              //         LOGICAL_MINIMUM (-32767)
+    0x26, 0xFF, 0x7F,              //         LOGICAL_MAXIMUM (32767)
+    0x75, 0x10,                    //         REPORT_SIZE (16)
+    0x81, 0x06,                    //         INPUT (Data,Var,Rel)
+    0xC0,                          //   END_COLLECTION
+
+    0x85, 0x05,                    //   Report ID 5
+    0x75, 0x04,                    //       REPORT_SIZE (4)     -   Pad the feature byte
+    0xB1, 0x03,                    //       FEATURE (Const,Var,Abs)
+    0xC0,                          // END COLLECTION
+
+    // Absolute pointer: places the cursor at an exact point on the screen
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x02,                    // USAGE (Mouse)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x85, 0x03,                    //   Report ID 3
+    0x09, 0x01,                    //   USAGE (Pointer)
+    0xA1, 0x00,                    //       COLLECTION (Physical)
+    0x95, 0x01,                    //           REPORT_COUNT (1)    -   No buttons: they are sent in Report ID 1 only
+    0x75, 0x08,                    //           REPORT_SIZE (8)
+    0x81, 0x03,                    //           INPUT (Const,Var,Abs)
+    0x05, 0x01,                    //      USAGE_PAGE (Generic Desktop)
+    0x09, 0x30,                    //      USAGE (X)
+    0x09, 0x31,                    //      USAGE (Y)
+    0x15, 0x00,                    //           LOGICAL_MINIMUM (0)
+    0x26, 0xFF, 0x7F,              //           LOGICAL_MAXIMUM (32767)
+    0x75, 0x10,                    //           REPORT_SIZE (16)
+    0x95, 0x02,                    //           REPORT_COUNT (2)
+    0x81, 0x02,                    //           INPUT (Data,Var,Abs)
     0xC0,                          //       END_COLLECTION
     0xC0,                          // END COLLECTION
- 
+};
+
+#if USB_BOOT_INTERFACES
+PROGMEM const uint8_t usbHidReportDescriptorKeyboard[] =  { 
+    // Boot keyboard report, as in the HID specification (Appendix B.1). No report ID
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x06,                    // USAGE (Keyboard)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x05, 0x07,                    //   USAGE_PAGE (Keyboard)
+
+    0x19, 0xe0,                    //   USAGE_MINIMUM (Keyboard LeftControl)
+    0x29, 0xe7,                    //   USAGE_MAXIMUM (Keyboard Right GUI)
+    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,                    //   REPORT_SIZE (1)
+
+    0x95, 0x08,                    //   REPORT_COUNT (8)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0x95, 0x01,                    //   REPORT_COUNT (1)
+    0x75, 0x08,                    //   REPORT_SIZE (8)
+    0x81, 0x03,                    //   INPUT (Cnst,Var,Abs)
+
+    0x95, 0x06,                    //   REPORT_COUNT (6)
+    0x75, 0x08,                    //   REPORT_SIZE (8)
+    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x25, 0x73,                    //   LOGICAL_MAXIMUM (115)
+    0x05, 0x07,                    //   USAGE_PAGE (Keyboard)
+
+    0x19, 0x00,                    //   USAGE_MINIMUM (Reserved (no event indicated))
+    0x29, 0x73,                    //   USAGE_MAXIMUM (Keyboard Application)
+    0x81, 0x00,                    //   INPUT (Data,Ary,Abs)
+    0x05, 0x08,                    //   USAGE_PAGE (LEDs)     -   Output: Num Lock, Caps Lock, Scroll Lock, Compose, Kana
+    0x19, 0x01,                    //   USAGE_MINIMUM (Num Lock)
+    0x29, 0x05,                    //   USAGE_MAXIMUM (Kana)
+    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
+    0x95, 0x05,                    //   REPORT_COUNT (5)
+    0x75, 0x01,                    //   REPORT_SIZE (1)
+    0x91, 0x02,                    //   OUTPUT (Data,Var,Abs)
+    0x95, 0x01,                    //   REPORT_COUNT (1)
+    0x75, 0x03,                    //   REPORT_SIZE (3)     -   Pad the byte
+    0x91, 0x03,                    //   OUTPUT (Cnst,Var,Abs)
+    0xc0,                          // END_COLLECTION
+};
+
+#else
+PROGMEM const uint8_t usbHidReportDescriptorKeyboard[] =  { 
     // Keyboard report, from Arduino official keyboard library
-    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)  // 47
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
     0x09, 0x06,                    // USAGE (Keyboard)
     0xa1, 0x01,                    // COLLECTION (Application)
     0x85, 0x02,                    //   REPORT_ID (2)
@@ -81,7 +222,158 @@ PROGMEM const uint8_t usbHidReportDescriptor[] =  {
     0x19, 0x00,                    //   USAGE_MINIMUM (Reserved (no event indicated))
     0x29, 0x73,                    //   USAGE_MAXIMUM (Keyboard Application)
     0x81, 0x00,                    //   INPUT (Data,Ary,Abs)
+    0x05, 0x08,                    //   USAGE_PAGE (LEDs)     -   Output: Num Lock, Caps Lock, Scroll Lock, Compose, Kana
+    0x19, 0x01,                    //   USAGE_MINIMUM (Num Lock)
+    0x29, 0x05,                    //   USAGE_MAXIMUM (Kana)
+    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
+    0x95, 0x05,                    //   REPORT_COUNT (5)
+    0x75, 0x01,                    //   REPORT_SIZE (1)
+    0x91, 0x02,                    //   OUTPUT (Data,Var,Abs)
+    0x95, 0x01,                    //   REPORT_COUNT (1)
+    0x75, 0x03,                    //   REPORT_SIZE (3)     -   Pad the byte
+    0x91, 0x03,                    //   OUTPUT (Cnst,Var,Abs)
+
+    // N-key rollover: one bit for every key, 0x04 - 0x73. Too big for one 8 byte packet,
+    // so the bitmap is split over Report IDs 6, 7 and 8. Bit n of the bitmap is always usage n.
+    0x85, 0x06,                    //   REPORT_ID (6)
+    0x05, 0x07,                    //   USAGE_PAGE (Keyboard)
+    0x19, 0xe0,                    //   USAGE_MINIMUM (Keyboard LeftControl)
+    0x29, 0xe7,                    //   USAGE_MAXIMUM (Keyboard Right GUI)
+    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,                    //   REPORT_SIZE (1)
+    0x95, 0x08,                    //   REPORT_COUNT (8)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0x95, 0x04,                    //   REPORT_COUNT (4)     -   Usages 0x00 - 0x03 are not keys
+    0x81, 0x03,                    //   INPUT (Cnst,Var,Abs)
+    0x19, 0x04,                    //   USAGE_MINIMUM (Keyboard a and A)
+    0x29, 0x2f,                    //   USAGE_MAXIMUM (Keyboard [ and {)
+    0x95, 0x2c,                    //   REPORT_COUNT (44)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+
+    0x85, 0x07,                    //   REPORT_ID (7)
+    0x19, 0x30,                    //   USAGE_MINIMUM (Keyboard ] and })
+    0x29, 0x67,                    //   USAGE_MAXIMUM (Keypad =)
+    0x95, 0x38,                    //   REPORT_COUNT (56)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+
+    0x85, 0x08,                    //   REPORT_ID (8)
+    0x19, 0x68,                    //   USAGE_MINIMUM (Keyboard F13)
+    0x29, 0x73,                    //   USAGE_MAXIMUM (Keyboard F24)
+    0x95, 0x0c,                    //   REPORT_COUNT (12)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0x95, 0x04,                    //   REPORT_COUNT (4)     -   Pad the byte
+    0x81, 0x03,                    //   INPUT (Cnst,Var,Abs)
     0xc0,                          // END_COLLECTION
 };
+#endif
+
+
+// Configuration: one HID interface per device
+// -------------------------------------------
+
+#define USB_HID_DESCRIPTOR_KEYBOARD     18      // Offsets into usbDescriptorConfiguration
+#define USB_HID_DESCRIPTOR_MOUSE        43
+
+// Interface class, subclass and protocol
+#if USB_BOOT_INTERFACES
+    #define USB_KEYBOARD_INTERFACE_TYPE     USB_CFG_INTERFACE_CLASS, 1, 1   // HID, boot, keyboard
+    #define USB_MOUSE_INTERFACE_TYPE        USB_CFG_INTERFACE_CLASS, 1, 2   // HID, boot, mouse
+#else
+    #define USB_KEYBOARD_INTERFACE_TYPE     USB_CFG_INTERFACE_CLASS, USB_CFG_INTERFACE_SUBCLASS, USB_CFG_INTERFACE_PROTOCOL
+    #define USB_MOUSE_INTERFACE_TYPE        USB_CFG_INTERFACE_CLASS, USB_CFG_INTERFACE_SUBCLASS, USB_CFG_INTERFACE_PROTOCOL
+#endif
+
+PROGMEM const unsigned char usbDescriptorConfiguration[] = {
+    9,                                  // sizeof(usbDescriptorConfiguration)
+    USBDESCR_CONFIG,                    // descriptor type
+    59, 0,                              // total length, including interface, HID and endpoint descriptors
+    2,                                  // number of interfaces
+    1,                                  // index of this configuration
+    0,                                  // configuration name string index
+#if USB_CFG_IS_SELF_POWERED
+    (1 << 7) | USBATTR_SELFPOWER,       // attributes
+#else
+    (1 << 7),                           // attributes
+#endif
+    USB_CFG_MAX_BUS_POWER/2,            // max USB current in 2mA units
+
+    // Keyboard interface
+    9,                                  // sizeof(usbDescrInterface)
+    USBDESCR_INTERFACE,                 // descriptor type
+    USB_INTERFACE_KEYBOARD,             // index of this interface
+    0,                                  // alternate setting
+    1,                                  // number of endpoints
+    USB_KEYBOARD_INTERFACE_TYPE,
+    0,                                  // string index for interface
+
+    9,                                  // sizeof(usbDescrHID)      -   offset 18
+    USBDESCR_HID,                       // descriptor type: HID
+    0x01, 0x01,                         // HID version 1.01
+    0x00,                               // target country code
+    0x01,                               // number of report descriptors
+    0x22,                               // descriptor type: report
+    sizeof(usbHidReportDescriptorKeyboard) & 0xFF, sizeof(usbHidReportDescriptorKeyboard) >> 8,
+
+    7,                                  // sizeof(usbDescrEndpoint)
+    USBDESCR_ENDPOINT,                  // descriptor type
+    0x81,                               // IN endpoint 1
+    0x03,                               // attrib: interrupt endpoint
+    8, 0,                               // maximum packet size
+    USB_CFG_INTR_POLL_INTERVAL,         // in ms
+
+    // Mouse interface
+    9,                                  // sizeof(usbDescrInterface)
+    USBDESCR_INTERFACE,                 // descriptor type
+    USB_INTERFACE_MOUSE,                // index of this interface
+    0,                                  // alternate setting
+    1,                                  // number of endpoints
+    USB_MOUSE_INTERFACE_TYPE,
+    0,                                  // string index for interface
+
+    9,                                  // sizeof(usbDescrHID)      -   offset 43
+    USBDESCR_HID,                       // descriptor type: HID
+    0x01, 0x01,                         // HID version 1.01
+    0x00,                               // target country code
+    0x01,                               // number of report descriptors
+    0x22,                               // descriptor type: report
+    sizeof(usbHidReportDescriptorMouse) & 0xFF, sizeof(usbHidReportDescriptorMouse) >> 8,
+
+    7,                                  // sizeof(usbDescrEndpoint)
+    USBDESCR_ENDPOINT,                  // descriptor type
+    0x80 | USB_CFG_EP3_NUMBER,          // IN endpoint 3
+    0x03,                               // attrib: interrupt endpoint
+    8, 0,                               // maximum packet size
+    USB_CFG_INTR_POLL_INTERVAL,         // in ms
+};
+
+
+// HID and report descriptors differ by interface, so V-USB asks for them here
+// (USB_PROP_IS_DYNAMIC, in usbconfig.h)
+usbMsgLen_t usbFunctionDescriptor(struct usbRequest *rq) {
+    uchar interface = rq->wIndex.bytes[0];
+
+    if (rq->wValue.bytes[1] == USBDESCR_HID) {
+        if (interface == USB_INTERFACE_MOUSE)
+            usbMsgPtr = (uchar *)(usbDescriptorConfiguration + USB_HID_DESCRIPTOR_MOUSE);
+        else
+            usbMsgPtr = (uchar *)(usbDescriptorConfiguration + USB_HID_DESCRIPTOR_KEYBOARD);
+        return 9;
+    }
+
+    if (rq->wValue.bytes[1] == USBDESCR_HID_REPORT) {
+        if (interface == USB_INTERFACE_MOUSE) {
+            usbMsgPtr = (uchar *)usbHidReportDescriptorMouse;
+            return sizeof(usbHidReportDescriptorMouse);
+        }
+        else {
+            usbMsgPtr = (uchar *)usbHidReportDescriptorKeyboard;
+            return sizeof(usbHidReportDescriptorKeyboard);
+        }
+    }
+
+    return 0;
+}
+
+#endif // !__cplusplus
 
 #endif //__HID_DESCRIPTOR_H__
\ No newline at end of file
@@ -1,6 +1,12 @@
 #include "util/delay.h"
+#include "util/atomic.h"
 #include "vusb_controller.h"
 
+// The one report each interface sends in boot protocol
+static uint8_t bootReportID(uint8_t interface) {
+    return (interface == VUSBController::KeyboardInterface) ? USB_REPORT_ID_KEYBOARD : USB_REPORT_ID_MOUSE;
+}
+
 VUSBController::VUSBController(PollingTimer timer, uint8_t pin_keepalive) {
     // Save the timer which was selected with macros in unoHID.h
     this->polling_timer = timer;
@@ -32,6 +38,17 @@ void VUSBController::begin() {
     }
     
 
+    // Nothing left over from a previous connection
+    forgetLastReports();
+    busReset();
+    for (InterruptEndpoint &endpoint : endpoints) {
+        discardAll(endpoint);
+        endpoint.last_hold = 0;
+        endpoint.sending = 0;
+        endpoint.in_flight = false;
+    }
+
+
     // Reconnect so device is detected
     // --------------------------------
     cli();
@@ -84,8 +101,13 @@ void VUSBController::begin() {
         TCCR1A = 0; // set entire TCCR1A register to 0
         TCCR1B = 0; // same for TCCR1B
         TCNT1  = 0; // initialize counter value to 0
+    #if USB_COUNT_SOF
+        // Start-of-frame pacing: check the endpoint once per USB frame (1 kHz)
+        OCR1A = 1999; // = 16000000 / (8 * 1000) - 1
+    #else
         // set compare match register for 125 Hz increments
         OCR1A = 15999; // = 16000000 / (8 * 125) - 1 (must be <65536)
+    #endif
         // turn on CTC mode
         TCCR1B |= (1 << WGM12);
         // Set CS12, CS11 and CS10 bits for 8 prescaler
@@ -100,12 +122,20 @@ void VUSBController::begin() {
         TCCR2A = 0;
         TCCR2B = 0;
         TCNT2 = 0;
-        // 100.16025641025641 Hz (16000000/((155+1)*1024))
-        OCR2A = 155;
         // CTC
         TCCR2A |= (1 << WGM21);
+    #if USB_COUNT_SOF
+        // Start-of-frame pacing: check the endpoint once per USB frame (1 kHz)
+        // 1000 Hz (16000000/((249+1)*64))
+        OCR2A = 249;
+        // Prescaler 64
+        TCCR2B |= (1 << CS22);
+    #else
+        // 100.16025641025641 Hz (16000000/((155+1)*1024))
+        OCR2A = 155;
         // Prescaler 1024
         TCCR2B |= (1 << CS22) | (1 << CS21) | (1 << CS20);
+    #endif
         // Output Compare Match A Interrupt Enable
         TIMSK2 |= (1 << OCIE2A);
         sei();
@@ -113,6 +143,9 @@ void VUSBController::begin() {
 }
 
 void VUSBController::end() {
+    // Let the host collect any reports still waiting (e.g. key releases)
+    flush();
+
     // Un-set timers
 
     if (polling_timer == Timer1) {
@@ -131,10 +164,756 @@ void VUSBController::end() {
     sei();
 }
 
+// One poll at a time. The timer interrupt lets other interrupts in (ISR_NOBLOCK), so V-USB's own interrupt is never
+// held up; but that also means it can fire again before the last poll has finished. And the sketch may call poll()
+// while the timer runs.
+// Whoever finds the lock free, with interrupts masked, does the work. Anyone else returns: it's being done
 void VUSBController::poll() {
-    // No autopolling if we're actually doing something
-    if(!autopolling_paused) {
-        usbPoll();
+    bool busy;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        busy = polling || autopolling_paused;
+        if (!busy)
+            polling = true;
+    }
+    if (busy)
+        return;
+
+    usbPoll();
+
+#if USB_COUNT_SOF
+    // Extend the driver's 8-bit frame counter
+    uint8_t sof = usbSofCount;
+    frames += (uint8_t)(sof - last_sof);
+    last_sof = sof;
+#endif
+
+    // Keyboard and mouse each have their own endpoint: both can go out in the same frame.
+    // An endpoint whose queue the sketch is in the middle of changing waits for the next poll
+    for (InterruptEndpoint &endpoint : endpoints) {
+        if (endpoint.updating)
+            continue;
+
+        expire(endpoint);
+        generate(endpoint);
+        repeat(endpoint);
+        transmit(endpoint);
+    }
+
+    polling = false;
+}
+
+// Called from poll(): either by the timer ISR, or by the user (POLL_MANUALLY)
+#if !USB_COUNT_SOF
+void VUSBController::transmit(InterruptEndpoint &endpoint) {
+    // Host hasn't collected the last report yet
+    if (!endpoint.isReady())
+        return;
+
+    if (endpoint.sending)
+        collected(endpoint);
+
+    // Previous report asked for a pause (tx_delay)
+    if (millis() - endpoint.last_sent < endpoint.last_hold)
+        return;
+
+    QueuedReport *next = nextReport(endpoint);
+    if (next == nullptr)
+        return;
+
+    endpoint.send(next->data, next->length);
+    endpoint.sending = next->handle;
+    endpoint.last_sent = millis();
+    endpoint.last_hold = next->hold;
+    if (next != &boot_step)
+        endpoint.queue.pop();
+}
+
+#else
+// Start-of-frame pacing. Polled every frame, so we see (to within 1ms) when the host collects a report.
+// The next report is loaded straight away, so it goes out on the very next host poll: one report per poll.
+// tx_delay is counted in frames from when the host collected the previous report, not from when it was loaded.
+void VUSBController::transmit(InterruptEndpoint &endpoint) {
+    if (endpoint.in_flight) {
+        // Host hasn't collected the last report yet
+        if (!endpoint.isReady())
+            return;
+
+        // Host has just collected it
+        endpoint.in_flight = false;
+        collected(endpoint);
+        endpoint.collected_at = frames;
+    }
+
+    // Previous report asked for a pause (tx_delay)
+    if ((uint16_t)(frames - endpoint.collected_at) < endpoint.last_hold)
+        return;
+
+    QueuedReport *next = nextReport(endpoint);
+    if (next == nullptr)
+        return;
+
+    endpoint.send(next->data, next->length);
+    endpoint.sending = next->handle;
+    endpoint.last_sent = millis();
+    endpoint.in_flight = true;
+    endpoint.last_hold = next->hold;
+    if (next != &boot_step)
+        endpoint.queue.pop();
+}
+
+#endif
+
+// The report leaves the queue without reaching the host. Remember its handle, so isDelivered() never claims it was
+void VUSBController::discard(InterruptEndpoint &endpoint, uint8_t index) {
+    QueuedReport *report = endpoint.queue.at(index);
+    if (report == nullptr)
+        return;
+
+    if (report->handle) {
+        uint8_t bit = (report->handle >> 1) % DISCARD_WINDOW;
+        endpoint.discarded[bit >> 3] |= 1 << (bit & 7);
+    }
+    endpoint.queue.remove(index);
+}
+
+void VUSBController::discardAll(InterruptEndpoint &endpoint) {
+    while (!endpoint.queue.isEmpty())
+        discard(endpoint, 0);
+}
+
+// Record the delivery, and let the sketch know. Idle repeats have no handle, and don't count
+void VUSBController::collected(InterruptEndpoint &endpoint) {
+    if (!endpoint.sending)
+        return;
+
+    endpoint.delivered = endpoint.sending;
+    endpoint.sending = 0;
+    sent++;
+
+    if (delivery_callback)
+        delivery_callback(endpoint.delivered);
+}
+
+// Host has stopped polling (or is far behind): reports which have waited past the deadline are no longer wanted.
+// Except the newest of each report ID, which leaves the host in the right state (keys released, buttons up)
+// whenever it catches up. Only its buttons still count, so any motion it carries is dropped
+void VUSBController::expire(InterruptEndpoint &endpoint) {
+    if (deadline == 0)
+        return;
+
+    uint16_t now = millis();
+    uint8_t index = 0;
+    QueuedReport *report;
+    while ((report = endpoint.queue.at(index)) != nullptr && (uint16_t)(now - report->queued_at) > deadline) {
+        if (superseded(endpoint.queue, index, 0)) {
+            if (report->handle)
+                timed_out++;
+            discard(endpoint, index);
+            continue;
+        }
+
+        LastReport *last = lastReport(report->data);
+        if (last && last->relative)
+            memset(report->data + 2, 0, report->length - 2);
+        index++;
+    }
+}
+
+// A later report with the same report ID (queued, or about to be) sets the host's state itself, so this one can go
+bool VUSBController::superseded(ReportQueue &queue, uint8_t index, uint8_t incoming_id) {
+    uint8_t id = queue.at(index)->data[0];
+    if (id == incoming_id)
+        return true;
+
+    QueuedReport *later;
+    while ((later = queue.at(++index)) != nullptr) {
+        if (later->data[0] == id)
+            return true;
+    }
+    return false;
+}
+
+// Only once the previous report has been collected, so each generated report is up to date when it goes out
+void VUSBController::generate(InterruptEndpoint &endpoint) {
+    if (!endpoint.source || !endpoint.queue.isEmpty() || !endpoint.isReady())
+        return;
+
+    uint8_t report[REPORT_MAX_LENGTH];
+    uint8_t length = 0;
+    if (endpoint.source(endpoint.source_context, report, &length) && length <= REPORT_MAX_LENGTH)
+        endpoint.queue.push(report, length, 0, newHandle(endpoint), millis());
+}
+
+// SET_IDLE: the host wants the current state again, whenever nothing has changed for idle_rate * 4ms
+void VUSBController::repeat(InterruptEndpoint &endpoint) {
+    if (!endpoint.idle_rate || !endpoint.queue.isEmpty() || !endpoint.isReady() || endpoint.sending)
+        return;
+
+    if (millis() - endpoint.last_sent < endpoint.idle_rate * 4UL)
+        return;
+
+    uint8_t interface = &endpoint - endpoints;
+    uint8_t report[REPORT_MAX_LENGTH];
+    for (LastReport &last : last_reports) {
+        if (!last.length || last.interface != interface)
+            continue;
+
+        // Boot protocol only has room for one report
+        if (bootFormat((Interface) interface) && last.data[0] != bootReportID(interface))
+            continue;
+
+        // Would put the cursor back where it was last placed
+        if (last.data[0] == USB_REPORT_ID_POINTER)
+            continue;
+
+        // No handle: the sketch never queued it, so it isn't counted or reported as a delivery
+        uint8_t length = stateReport(last, report);
+        endpoint.queue.push(report, length, 0, 0, millis());
+    }
+}
+
+// In boot format, reports are converted as they go out. Those with no boot equivalent are dropped
+QueuedReport* VUSBController::nextReport(InterruptEndpoint &endpoint) {
+    uint8_t interface = &endpoint - endpoints;
+    QueuedReport *next;
+    while ((next = endpoint.queue.front()) != nullptr && bootFormat((Interface) interface)) {
+        if (interface == MouseInterface && bootStep(next))
+            return &boot_step;
+
+        uint8_t length = toBootReport(interface, next->data, next->length);
+        if (length) {
+            next->length = length;
+            break;
+        }
+
+        discard(endpoint, 0);
+        dropped++;
+    }
+    return next;
+}
+
+// Boot mouse motion is limited to +-127. A longer move goes out in steps: each is taken off the queued report,
+// which stays at the front of the queue (and keeps its handle) until what is left fits in one boot report
+bool VUSBController::bootStep(QueuedReport *report) {
+    if (report->data[0] != USB_REPORT_ID_MOUSE || report->length != 6)
+        return false;
+
+    int16_t x = report->data[2] | (report->data[3] << 8);
+    int16_t y = report->data[4] | (report->data[5] << 8);
+    if (x >= -127 && x <= 127 && y >= -127 && y <= 127)
+        return false;
+
+    int8_t step_x = constrain(x, -127, 127);
+    int8_t step_y = constrain(y, -127, 127);
+    x -= step_x;
+    y -= step_y;
+    report->data[2] = x & 0xFF;
+    report->data[3] = x >> 8;
+    report->data[4] = y & 0xFF;
+    report->data[5] = y >> 8;
+
+    boot_step.length = 3;
+    boot_step.hold = 0;
+    boot_step.handle = 0;
+    boot_step.data[0] = report->data[1];
+    boot_step.data[1] = step_x;
+    boot_step.data[2] = step_y;
+    return true;
+}
+
+// Boot protocol: keyboard [modifiers, reserved, 6 keys], mouse [buttons, x, y]. No report IDs.
+// Returns the new length, or 0 for N-key rollover, absolute position and scrolling, which the BIOS wouldn't understand
+uint8_t VUSBController::toBootReport(uint8_t interface, uint8_t *report, uint8_t length) {
+    if (report[0] != bootReportID(interface))
+        return 0;
+
+    if (interface == KeyboardInterface && length == 8) {
+    #if USB_BOOT_INTERFACES
+        report[0] = report[1];      // [ID, modifiers, 6 keys]
+        report[1] = 0;
+    #else
+        memmove(report, report + 1, 7);     // [ID, modifiers, reserved, 5 keys]
+        report[7] = 0;
+    #endif
+        return 8;
+    }
+
+    if (interface == MouseInterface && length == 6) {
+        int16_t x = report[2] | (report[3] << 8);
+        int16_t y = report[4] | (report[5] << 8);
+        report[0] = report[1];
+        report[1] = constrain(x, -127, 127);
+        report[2] = constrain(y, -127, 127);
+        return 3;
+    }
+
+    return 0;
+}
+
+// The state a report leaves behind on the host. Relative reports (mouse motion) have already been applied:
+// only their buttons (byte 1) still stand, so the motion is zeroed
+uint8_t VUSBController::stateReport(const LastReport &last, uint8_t *report) {
+    memcpy(report, last.data, last.length);
+    if (last.relative)
+        memset(report + 2, 0, last.length - 2);
+
+    return last.length;
+}
+
+// GET_REPORT (Input): what the host will see once the queue is empty.
+// Zero length if nothing has been sent yet, or the state was lost when a report was dropped
+usbMsgLen_t VUSBController::getReport(uint8_t interface, uint8_t report_id) {
+    bool boot = bootFormat((Interface) interface);
+    if (boot)
+        report_id = bootReportID(interface);
+
+    // Being rewritten by queueReport(), so not known right now
+    if (endpoints[interface].updating)
+        return 0;
+
+    LastReport *last = lastReport(&report_id);
+    if (!last || !last->length || last->interface != interface)
+        return 0;
+
+    uint8_t length = stateReport(*last, reply);
+    if (boot)
+        length = toBootReport(interface, reply, length);
+
+    usbMsgPtr = reply;
+    return length;
+}
+
+// Handle: sequence number, and which endpoint it belongs to
+ReportHandle VUSBController::newHandle(InterruptEndpoint &endpoint) {
+    uint8_t interface = &endpoint - endpoints;
+    ReportHandle handle = (endpoint.next_sequence << 1) | interface;
+
+    // The bit last belonged to a report DISCARD_WINDOW numbers ago
+    uint8_t bit = endpoint.next_sequence % DISCARD_WINDOW;
+    endpoint.discarded[bit >> 3] &= ~(1 << (bit & 7));
+
+    endpoint.next_sequence = (endpoint.next_sequence + 1) & 0x7FFF;
+    if (endpoint.next_sequence == 0)
+        endpoint.next_sequence = 1;
+
+    return handle;
+}
+
+LastReport* VUSBController::lastReport(const uint8_t *report) {
+    uint8_t id = report[0];
+    if (id == 0 || id > REPORT_ID_LAST)
+        return nullptr;
+
+    return &last_reports[id - 1];
+}
+
+void VUSBController::forgetLastReports() {
+    for (LastReport &last : last_reports)
+        last.length = 0;
+}
+
+uint16_t VUSBController::frameCount() {
+    uint16_t now;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        now = frames;
+    }
+    return now;
+}
+
+// Copy a report into the interface's queue, to be sent in the background. 
+// If a merge function is given, the report is first combined with the newest queued report, if possible.
+// If the queue is full, the QueuePolicy decides: wait for room (until the deadline), or drop a report.
+// A report identical to the previous one with the same report ID changes nothing for the host, and is skipped.
+// Reports with a merge function carry relative data (mouse motion), so are always sent.
+// Returns a handle for the report (see isDelivered), or 0 if it was not queued.
+ReportHandle VUSBController::queueReport(Interface interface, const uint8_t *report, uint8_t length, uint16_t hold, ReportMerger merge) {
+    InterruptEndpoint &endpoint = endpoints[interface];
+    ReportQueue &queue = endpoint.queue;
+    ReportHandle handle = 0;
+
+    if (length > REPORT_MAX_LENGTH)
+        return 0;
+
+    uint8_t pending[REPORT_MAX_LENGTH];
+    memcpy(pending, report, length);
+
+    // Skip duplicates. A position may be the same as last time, but the cursor needn't still be there
+    claim(endpoint);
+    LastReport *last = lastReport(pending);
+    if (last && !merge && !last->relative && pending[0] != USB_REPORT_ID_POINTER &&
+        last->length == length && memcmp(last->data, pending, length) == 0)
+        handle = last->handle;
+    release(endpoint);
+    if (handle)
+        return handle;
+
+    uint32_t start = millis();
+
+    while (true) {
+        claim(endpoint);
+
+        // The endpoint is still busy: fold into the report which is waiting, instead of adding another
+        QueuedReport *waiting = queue.back();
+        if (merge && waiting && waiting->length == length && merge(waiting->data, pending))
+            handle = waiting->handle;
+
+        else {
+            // Make room by giving up on the oldest report which a later one makes redundant. If every report
+            // is the last of its report ID, nothing can go without leaving the host in the wrong state: wait instead
+            if (queue.isFull() && queue_policy == DropOldest) {
+                for (uint8_t i = 0; i < queue.size(); i++) {
+                    if (superseded(queue, i, pending[0])) {
+                        if (queue.at(i)->handle)
+                            count(dropped);
+                        discard(endpoint, i);
+                        break;
+                    }
+                }
+            }
+
+            if (!queue.isFull()) {
+                handle = newHandle(endpoint);
+                queue.push(pending, length, hold, handle, millis());
+
+                // Remember it, to spot a duplicate next time (and for GET_REPORT)
+                if (last) {
+                    last->length = length;
+                    last->interface = interface;
+                    last->relative = (merge != nullptr);
+                    last->handle = handle;
+                    memcpy(last->data, pending, length);
+                }
+            }
+            else if (queue_policy == DropNewest)
+                count(dropped);
+        }
+
+        release(endpoint);
+        if (handle)
+            break;
+
+        if (queue_policy == DropNewest)
+            return 0;
+
+        // Queue is full. Wait without the claim, so poll() can drain it: the timer will make room,
+        // unless we are polling manually
+        while (!available(interface)) {
+            pollIfManual();
+
+            // No deadline set: give up if the host stops collecting reports for 5 seconds
+            if (millis() - start > (deadline ? deadline : 5000)) {
+                count(timed_out);
+                return 0;
+            }
+        }
+    }
+
+    // Manual polling: no need to wait until the next VUSB.poll() to start sending
+    if (polling_timer == Manual)
+        poll();
+
+    return handle;
+}
+
+// poll() leaves an endpoint alone while the sketch changes its queue. Only the flag itself needs interrupts masked:
+// the copying and merging happen with the USB interrupt free to come in
+void VUSBController::claim(InterruptEndpoint &endpoint) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        endpoint.updating = true;
+    }
+}
+
+void VUSBController::release(InterruptEndpoint &endpoint) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        endpoint.updating = false;
+    }
+}
+
+// Statistics are shared with poll(): a 32-bit increment isn't a single instruction
+void VUSBController::count(uint32_t &counter) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        counter++;
+    }
+}
+
+uint8_t VUSBController::available(Interface interface) {
+    uint8_t free;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        free = endpoints[interface].queue.available();
+    }
+    return free;
+}
+
+// Sequence numbers wrap around, so "delivered" means: no more than half the range behind the latest delivery.
+// Reports which were thrown away unsent (dropped, expired, or discarded by flush()) are never delivered.
+// That is known for the last DISCARD_WINDOW reports on each endpoint, which covers everything still queued.
+bool VUSBController::isDelivered(ReportHandle handle) {
+    if (handle == 0)
+        return false;
+
+    InterruptEndpoint &endpoint = endpoints[handle & 1];
+    uint16_t sequence = handle >> 1;
+    uint16_t next;
+    uint8_t discarded;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        next = endpoint.next_sequence;
+        discarded = endpoint.discarded[(sequence % DISCARD_WINDOW) >> 3];
+    }
+    uint16_t age = (next - sequence) & 0x7FFF;
+    if (age <= DISCARD_WINDOW && (discarded & (1 << ((sequence % DISCARD_WINDOW) & 7))))
+        return false;
+
+    ReportHandle latest;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        latest = endpoint.delivered;
+    }
+    if (latest == 0)
+        return false;
+
+    uint16_t behind = ((latest >> 1) - (handle >> 1)) & 0x7FFF;
+    return behind < 0x4000;
+}
+
+void VUSBController::onDelivered(DeliveryCallback callback) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        delivery_callback = callback;
+    }
+}
+
+bool VUSBController::isIdle() {
+    bool idle = true;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (InterruptEndpoint &endpoint : endpoints) {
+            if (!endpoint.queue.isEmpty() || !endpoint.isReady())
+                idle = false;
+        }
+    }
+    return idle;
+}
+
+// Block until the host has collected every queued report
+void VUSBController::flush() {
+    uint32_t start = millis();
+
+    while (!isIdle()) {
+        pollIfManual();
+
+        // Host has stopped listening
+        if (millis() - start > 5000) {
+            for (InterruptEndpoint &endpoint : endpoints) {
+                claim(endpoint);
+                uint8_t discarded = REPORT_QUEUE_LENGTH - endpoint.queue.available();
+                discardAll(endpoint);
+                release(endpoint);
+
+                ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                    timed_out += discarded;
+                }
+            }
+            forgetLastReports();
+            break;
+        }
+    }
+}
+
+// Called by V-USB, from usbPoll(), for requests it doesn't handle itself: the HID class requests.
+// Anything else is ignored.
+usbMsgLen_t VUSBController::functionSetup(uchar data[8]) {
+    usbRequest_t *rq = (usbRequest_t*) data;
+
+    if ((rq->bmRequestType & USBRQ_TYPE_MASK) != USBRQ_TYPE_CLASS)
+        return 0;
+
+    uint8_t interface = rq->wIndex.bytes[0];
+    if (interface > MouseInterface)
+        return 0;
+    InterruptEndpoint &endpoint = endpoints[interface];
+
+    uint8_t report_type = rq->wValue.bytes[1];     // 1: Input, 2: Output, 3: Feature
+    uint8_t report_id = rq->wValue.bytes[0];
+    bool feature = (interface == MouseInterface && report_type == 3 && report_id == feature_report[0]);
+
+    switch (rq->bRequest) {
+        case USBRQ_HID_GET_REPORT:
+            if (feature) {
+                usbMsgPtr = feature_report;
+                return sizeof(feature_report);
+            }
+            if (report_type == 1)
+                return getReport(interface, report_id);
+            break;
+
+        // Data follows. V-USB passes it to functionWrite()
+        case USBRQ_HID_SET_REPORT:
+            if (feature) {
+                write_target = feature_report;
+                write_remaining = sizeof(feature_report);
+                output_length = 0;
+                return USB_NO_MSG;
+            }
+            // Keyboard LEDs. With a report ID, it comes first
+            if (interface == KeyboardInterface && report_type == 2) {
+                write_target = output_report;
+                write_remaining = output_length = min(rq->wLength.bytes[0], sizeof(output_report));
+                return USB_NO_MSG;
+            }
+            break;
+
+        // One rate for the whole interface, whichever report ID is given
+        case USBRQ_HID_SET_IDLE:
+            endpoint.idle_rate = rq->wValue.bytes[1];
+            break;
+
+        case USBRQ_HID_GET_IDLE:
+            usbMsgPtr = &endpoint.idle_rate;
+            return 1;
+
+        case USBRQ_HID_SET_PROTOCOL:
+            endpoint.protocol = rq->wValue.bytes[0] ? ReportProtocol : BootProtocol;
+            break;
+
+        case USBRQ_HID_GET_PROTOCOL:
+            usbMsgPtr = &endpoint.protocol;
+            return 1;
+    }
+
+    return 0;
+}
+
+// Data stage of SET_REPORT, up to 8 bytes at a time. Return 1 when complete
+uchar VUSBController::functionWrite(uchar *data, uchar len) {
+    if (write_target == nullptr)
+        return 0xFF;    // Stall: not expecting data
+
+    len = min(len, write_remaining);
+    memcpy(write_target, data, len);
+    write_target += len;
+    write_remaining -= len;
+
+    if (write_remaining == 0) {
+        write_target = nullptr;
+        if (output_length)
+            receivedLeds();
+        return 1;
+    }
+    return 0;
+}
+
+// Report protocol: [ID 2, LEDs]. Boot protocol (or USB_BOOT_INTERFACES): [LEDs]
+void VUSBController::receivedLeds() {
+    uint8_t value;
+    if (output_length == 2 && output_report[0] == USB_REPORT_ID_KEYBOARD)
+        value = output_report[1];
+    else if (output_length == 1)
+        value = output_report[0];
+    else
+        return;
+
+    changeLeds(value);
+}
+
+void VUSBController::changeLeds(uint8_t value) {
+    if (value == leds)
+        return;
+
+    leds = value;
+    led_changes++;
+    if (led_callback)
+        led_callback(value);
+}
+
+// USB bus reset, from V-USB (USB_RESET_HOOK): a new host, or the BIOS handing over to the OS.
+// The HID spec wants report protocol after a reset, and nothing else the last host set carries over
+void VUSBController::busReset() {
+    write_target = nullptr;
+    output_length = 0;
+    feature_report[1] = 0;
+    for (InterruptEndpoint &endpoint : endpoints) {
+        endpoint.protocol = ReportProtocol;
+        endpoint.idle_rate = 0;
+    }
+    endpoints[KeyboardInterface].idle_rate = 500 / 4;  // HID spec default for keyboards, until the host sets its own
+    changeLeds(0);
+}
+
+uint8_t VUSBController::resolutionMultiplier() {
+    return feature_report[1];
+}
+
+uint8_t VUSBController::ledStatus() {
+    return leds;
+}
+
+uint8_t VUSBController::ledChangeCount() {
+    return led_changes;
+}
+
+void VUSBController::onLedChange(LedCallback callback) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        led_callback = callback;
+    }
+}
+
+VUSBController::Protocol VUSBController::protocol(Interface interface) {
+    return (Protocol) endpoints[interface].protocol;
+}
+
+// Boot protocol, or a boot keyboard interface, whose report descriptor has no report IDs either way
+bool VUSBController::bootFormat(Interface interface) {
+    if (USB_BOOT_INTERFACES && interface == KeyboardInterface)
+        return true;
+
+    return endpoints[interface].protocol == BootProtocol;
+}
+
+void VUSBController::setReportSource(Interface interface, ReportSource source, void *context) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        endpoints[interface].source = source;
+        endpoints[interface].source_context = context;
+    }
+}
+
+void VUSBController::setQueuePolicy(QueuePolicy policy) {
+    this->queue_policy = policy;
+}
+
+// Ages are compared in 16 bits (see expire()), so a longer deadline would wrap around and expire everything at once
+void VUSBController::setDeadline(uint16_t duration) {
+    duration = min(duration, 30000U);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        this->deadline = duration;
+    }
+}
+
+uint32_t VUSBController::sentCount() {
+    uint32_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        count = sent;
+    }
+    return count;
+}
+
+uint32_t VUSBController::droppedCount() {
+    uint32_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        count = dropped;
+    }
+    return count;
+}
+
+uint32_t VUSBController::timedOutCount() {
+    uint32_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        count = timed_out;
+    }
+    return count;
+}
+
+void VUSBController::resetCounts() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sent = 0;
+        dropped = 0;
+        timed_out = 0;
     }
 }
 
@@ -162,6 +941,13 @@ void VUSBController::keyboardOn() {
         begin();
 }
 
+void VUSBController::pollIfManual() {
+    if (polling_timer == Manual)
+        poll();
+}
+
+// Hold off polling, e.g. around timing-critical code. Reports wait in the queue until polling resumes.
+// Sending doesn't need this: queueReport() only touches the queue, and poll() guards itself
 void VUSBController::pausePolling() {
     autopolling_paused = true;
 }
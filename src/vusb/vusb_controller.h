@@ -3,12 +3,92 @@
 
 #include <Arduino.h>
 #include "vusb/driver/usbdrv.h"
+#include "vusb/report_queue.h"
+#include "vusb/usb_descriptor.h"
+
+// Combine an incoming report into one which is still waiting in the queue.
+// Whatever can't be combined is left in "incoming". Return true if nothing is left to send.
+typedef bool (*ReportMerger)(uint8_t *queued, uint8_t *incoming);
+
+// Reports with IDs 1 to REPORT_ID_LAST are checked for duplicates, before queuing
+#define REPORT_ID_LAST 8
+
+// Identifies one queued report, so the sketch can find out when the host has collected it.
+// Returned by Keyboard and Mouse methods. 0 means the report was never queued.
+typedef uint16_t ReportHandle;
+
+// isDelivered() tells a report thrown away unsent from a delivered one, for this many of the latest on each endpoint
+#define DISCARD_WINDOW (REPORT_QUEUE_LENGTH * 8)
+
+// Called (from the polling interrupt) as soon as the host collects a report
+typedef void (*DeliveryCallback)(ReportHandle handle);
+
+// Called (from the polling interrupt) when the host turns Caps Lock, Num Lock etc. on or off
+typedef void (*LedCallback)(uint8_t leds);
+
+// Asked (from the polling interrupt) for a report, whenever an endpoint is idle. Return false if there is nothing to send
+typedef bool (*ReportSource)(void *context, uint8_t *report, uint8_t *length);
+
+// One interrupt-in endpoint, with its own queue and pacing, so the mouse never waits behind the keyboard
+struct InterruptEndpoint {
+    InterruptEndpoint(usbTxStatus_t *tx_status, void (*send)(uchar *data, uchar len)) 
+        : tx_status(tx_status), send(send) {}
+
+    bool isReady() { return tx_status->len & 0x10; }   // Host has collected the last report (usbInterruptIsReady)
+
+    usbTxStatus_t *tx_status;               // V-USB's transmit buffer for this endpoint
+    void (*send)(uchar *data, uchar len);   // usbSetInterrupt() or usbSetInterrupt3()
+
+    // Reports waiting for the endpoint
+    ReportQueue queue;
+    uint32_t last_sent = 0;         // When the previous report was handed to V-USB
+    uint16_t last_hold = 0;         // How long the previous report asked to be left alone (tx_delay)
+
+    // Delivery tracking
+    uint16_t next_sequence = 1;             // Numbers each queued report (15 bits, skips 0)
+    ReportHandle sending = 0;               // Report sitting in the endpoint, waiting for the host
+    volatile ReportHandle delivered = 0;    // Most recent report the host has collected
+    uint8_t discarded[REPORT_QUEUE_LENGTH] = {};    // A bit for each of the latest sequence numbers: thrown away unsent
+
+    // HID class requests (SET_IDLE, SET_PROTOCOL)
+    uint8_t idle_rate = 0;          // Repeat the current state after this long without a change (4ms units). 0: never
+    uint8_t protocol = 1;           // 0: boot protocol, 1: report protocol
+
+    // The sketch is changing the queue (queueReport): poll() leaves this endpoint until the next time
+    volatile bool updating = false;
+
+    // Generates reports on the fly (e.g. Mouse.glide), instead of the sketch queuing them
+    ReportSource source = nullptr;
+    void *source_context = nullptr;
+
+    // Start-of-frame pacing (USB_COUNT_SOF). Always present, so the layout is the same whatever the setting
+    bool in_flight = false;         // A report is in the endpoint, waiting for the host
+    uint16_t collected_at = 0;      // Frame when the host last collected a report
+} ;
+
+// Most recent report queued with a particular report ID: what the host will see, once the queue empties
+struct LastReport {
+    uint8_t length = 0;             // 0: unknown, don't compare
+    uint8_t interface;
+    bool relative;                  // Queued with a merge function (e.g. mouse motion): never a duplicate
+    ReportHandle handle;
+    uint8_t data[REPORT_MAX_LENGTH];
+} ;
 
 class VUSBController {
     public:
         // Store the timer which was selected with macros in unoHID.h
         enum PollingTimer : int8_t { Timer2 = 2, Timer1 = 1, Manual = -1 }; 
 
+        // HID interfaces, as numbered in the configuration descriptor (usb_descriptor.h). Each has its own endpoint.
+        enum Interface : uint8_t { KeyboardInterface = USB_INTERFACE_KEYBOARD, MouseInterface = USB_INTERFACE_MOUSE };
+
+        // What to do with a new report when the queue is full (host not polling)
+        enum QueuePolicy : uint8_t { Block, DropOldest, DropNewest };
+
+        // Report format the host has asked for (SET_PROTOCOL). Boot protocol is for BIOS / UEFI
+        enum Protocol : uint8_t { BootProtocol = 0, ReportProtocol = 1 };
+
         // Insist on a timer
         VUSBController() = delete;
         VUSBController(PollingTimer timer, uint8_t pin_keepalive);
@@ -19,12 +99,63 @@ class VUSBController {
         void keyboardOn();
 
         void poll();
+        void pollIfManual();        // For code which waits on the host. The timer does it otherwise
         void pausePolling();
         void resumePolling();
 
+        ReportHandle queueReport(Interface interface, const uint8_t *report, uint8_t length, uint16_t hold = 0, ReportMerger merge = nullptr);   // Returns immediately, unless queue is full
+        void flush();                                                                   // Wait until every queued report is sent
+        uint8_t available(Interface interface);                                         // Reports which can be queued without waiting
+
+        bool isDelivered(ReportHandle handle);              // Has the host collected this report yet?
+        void onDelivered(DeliveryCallback callback);        // Run callback each time the host collects a report
+        void setReportSource(Interface interface, ReportSource source, void *context);  // nullptr to stop
+
+        void setQueuePolicy(QueuePolicy policy);
+        void setDeadline(uint16_t duration);                // Give up on reports which wait longer than this (ms). 0: no deadline
+
+        uint32_t sentCount();           // Reports collected by the host. Not idle repeats, which the sketch never queued
+        uint32_t droppedCount();        // Reports thrown away: queue full (DropOldest, DropNewest), or no boot protocol equivalent
+        uint32_t timedOutCount();       // Reports which missed their deadline
+        void resetCounts();
+
+        // HID class requests, from V-USB (see usbFunctionSetup.h)
+        usbMsgLen_t functionSetup(uchar data[8]);
+        uchar functionWrite(uchar *data, uchar len);
+        void busReset();                    // Back to the defaults: report protocol, default idle rates, no multiplier, LEDs off
+
+        uint8_t resolutionMultiplier();     // Feature Report ID 5, as set by the host. Bit 0: wheel, bit 2: pan
+        Protocol protocol(Interface interface);     // As set by the host
+        uint8_t ledStatus();                        // Keyboard LEDs, from the host's output report. Bit 0: Num Lock, 1: Caps Lock, 2: Scroll Lock
+        void onLedChange(LedCallback callback);     // Run callback each time the LEDs change
+        uint8_t ledChangeCount();                   // How many times the LEDs have changed (wraps), to spot an answer from the host
+        bool bootFormat(Interface interface);       // Reports go out as boot reports, with no report ID
+
+        uint16_t frameCount();          // USB frames (1ms) since begin, counted from the host's Start-Of-Frame markers. 0 without USB_COUNT_SOF
+
     private:
         void begin();
         void end();
+        void transmit(InterruptEndpoint &endpoint);     // Hand the next queued report to V-USB, if the endpoint is free
+        bool isIdle();                                  // Nothing queued, nothing waiting for the host
+        void expire(InterruptEndpoint &endpoint);       // Discard queued reports which are past their deadline
+        bool superseded(ReportQueue &queue, uint8_t index, uint8_t incoming_id);    // A later report has the same ID
+        void generate(InterruptEndpoint &endpoint);     // Ask the endpoint's ReportSource for a report, if idle
+        void repeat(InterruptEndpoint &endpoint);       // Resend the current state, if the idle rate has passed
+        QueuedReport* nextReport(InterruptEndpoint &endpoint);  // Front of the queue, in the format the host expects
+        uint8_t toBootReport(uint8_t interface, uint8_t *report, uint8_t length);   // 0: no boot equivalent
+        bool bootStep(QueuedReport *report);            // Too much motion for one boot report: take a step off it
+        uint8_t stateReport(const LastReport &last, uint8_t *report);              // For GET_REPORT and idle repeats
+        usbMsgLen_t getReport(uint8_t interface, uint8_t report_id);
+        ReportHandle newHandle(InterruptEndpoint &endpoint);
+        LastReport* lastReport(const uint8_t *report);  // Nullptr if this report ID isn't tracked
+        void forgetLastReports();                       // Host state no longer known (flush() gave up, or a new connection)
+        void collected(InterruptEndpoint &endpoint);    // The host has taken the report from the endpoint
+        void discard(InterruptEndpoint &endpoint, uint8_t index);   // Throw away a queued report, unsent
+        void discardAll(InterruptEndpoint &endpoint);
+        void claim(InterruptEndpoint &endpoint);        // Keep poll() away from the endpoint's queue...
+        void release(InterruptEndpoint &endpoint);      // ...until the sketch is done with it
+        void count(uint32_t &counter);                  // Add one to a statistic, safe from poll()
 
     // Members
     private:
@@ -33,6 +164,52 @@ class VUSBController {
         
         PollingTimer polling_timer;
         volatile bool autopolling_paused = false;
+        volatile bool polling = false;      // poll() is running. Taken with interrupts masked
+
+        DeliveryCallback delivery_callback = nullptr;
+
+        QueuePolicy queue_policy = Block;
+        uint16_t deadline = 0;          // ms. At most 30000
+
+        // Duplicate detection, indexed by report ID - 1
+        LastReport last_reports[REPORT_ID_LAST];
+
+        // Feature report: Resolution Multiplier (usb_descriptor.h). Reset with the bus
+        uint8_t feature_report[2] = {0x05, 0};
+
+        // Part of a mouse movement too long for one boot report. Sent in place of the queued report, which stays queued
+        QueuedReport boot_step;
+
+        // Reply to GET_REPORT. Must outlive functionSetup(), until V-USB has sent it
+        uint8_t reply[REPORT_MAX_LENGTH];
+
+        // Control transfer in progress (SET_REPORT)
+        uint8_t *write_target = nullptr;
+        uint8_t write_remaining = 0;
+
+        // Keyboard output report: [report ID,] LEDs
+        uint8_t output_report[2];
+        uint8_t output_length = 0;      // Bytes expected. 0: not receiving an output report
+        volatile uint8_t leds = 0;
+        volatile uint8_t led_changes = 0;
+        LedCallback led_callback = nullptr;
+        void receivedLeds();
+        void changeLeds(uint8_t value);
+
+        // Statistics
+        uint32_t sent = 0;
+        uint32_t dropped = 0;
+        uint32_t timed_out = 0;
+
+        // Keyboard on endpoint 1, mouse on endpoint 3. Indexed by Interface
+        InterruptEndpoint endpoints[2] = {
+            InterruptEndpoint(&usbTxStatus1, usbSetInterrupt),
+            InterruptEndpoint(&usbTxStatus3, usbSetInterrupt3)
+        };
+
+        // Start-of-frame pacing: time is counted in frames, from the moment the host collects a report
+        volatile uint16_t frames = 0;
+        uint8_t last_sof = 0;           // usbSofCount at the previous poll, to extend it to 16 bits
 
         // Workaround for obsure error with nano
         uint8_t pin_keepalive = -1;